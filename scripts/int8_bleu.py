@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+# Translates a reference set with and without --int8 and reports the BLEU
+# delta and the translation times, to decide per model whether the int8
+# path is acceptable.
+
+from __future__ import print_function, division
+
+import argparse
+import collections
+import math
+import subprocess
+import sys
+import time
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-a', '--amun', default='amun',
+                    help="Path to the amun executable")
+parser.add_argument('-c', '--config', required=True,
+                    help="amun config file of the model")
+parser.add_argument('-i', '--input', required=True,
+                    help="Source side of the reference set")
+parser.add_argument('-r', '--reference', required=True,
+                    help="Target side of the reference set")
+parser.add_argument('extra', nargs=argparse.REMAINDER,
+                    help="Further amun options, e.g. --cpu-threads 8")
+args = parser.parse_args()
+
+
+def ngrams(words, n):
+    return collections.Counter(tuple(words[i:i + n]) for i in range(len(words) - n + 1))
+
+
+# Corpus BLEU with up to 4-grams and the brevity penalty, on whitespace tokens.
+def bleu(hypotheses, references):
+    matches = [0] * 4
+    totals = [0] * 4
+    hypLength = 0
+    refLength = 0
+    for hyp, ref in zip(hypotheses, references):
+        hyp = hyp.split()
+        ref = ref.split()
+        hypLength += len(hyp)
+        refLength += len(ref)
+        for n in range(1, 5):
+            hypNgrams = ngrams(hyp, n)
+            refNgrams = ngrams(ref, n)
+            matches[n - 1] += sum(min(c, refNgrams[g]) for g, c in hypNgrams.items())
+            totals[n - 1] += max(len(hyp) - n + 1, 0)
+    if min(matches) == 0:
+        return 0.0
+    logPrecision = sum(math.log(m / t) for m, t in zip(matches, totals)) / 4
+    brevity = min(0.0, 1.0 - refLength / hypLength)
+    return 100.0 * math.exp(logPrecision + brevity)
+
+
+def translate(options):
+    with open(args.input) as source:
+        start = time.time()
+        output = subprocess.check_output([args.amun, '-c', args.config] + options + args.extra,
+                                         stdin=source)
+        seconds = time.time() - start
+    return output.decode('utf-8').splitlines(), seconds
+
+
+with open(args.reference) as reference:
+    references = reference.read().splitlines()
+
+fp32, fp32Time = translate([])
+int8, int8Time = translate(['--int8'])
+
+fp32Bleu = bleu(fp32, references)
+int8Bleu = bleu(int8, references)
+print("fp32 BLEU {:.2f} in {:.1f}s".format(fp32Bleu, fp32Time))
+print("int8 BLEU {:.2f} in {:.1f}s".format(int8Bleu, int8Time))
+print("delta {:+.2f} BLEU, {:.2f}x speed".format(int8Bleu - fp32Bleu, fp32Time / int8Time))
+if len(fp32) != len(references):
+    print("warning: {} translations for {} references".format(len(fp32), len(references)),
+          file=sys.stderr)
@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+# Converts an .npz model to amun's binary model format, which the CPU
+# backend maps into memory instead of reading (see src/amun/cpu/binary_model.h).
+# The result is a drop-in replacement for the .npz in the amun config.
+
+from __future__ import print_function
+
+import argparse
+import struct
+
+import numpy as np
+
+MAGIC = b'AMUNBIN1'
+ALIGNMENT = 64  # bytes, for tensor offsets
+PADDING = 16    # floats, rows are padded to a multiple of this
+FLOAT32 = 0
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-i', '--input', required=True, help="Model in .npz format")
+parser.add_argument('-o', '--output', required=True, help="Binary model to write")
+args = parser.parse_args()
+
+
+def align(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+model = np.load(args.input)
+tensors = []
+for name in sorted(model.files):
+    array = np.asarray(model[name], dtype=np.float32)
+    if array.ndim > 2:
+        print("Skipping {} with shape {}".format(name, array.shape))
+        continue
+    # vectors are stored as rows, i.e. transposed
+    transposed = int(array.ndim < 2)
+    rows, cols = array.reshape(1, -1).shape if transposed else array.shape
+    tensors.append((name.encode('utf-8'), transposed, rows, cols, align(cols, PADDING),
+                    array.reshape(rows, cols)))
+
+header = MAGIC + struct.pack('<Q', len(tensors))
+for name, _, _, _, _, _ in tensors:
+    header += struct.pack('<Q', len(name)) + name + struct.pack('<6Q', *([0] * 6))
+
+offsets = []
+offset = align(len(header), ALIGNMENT)
+for _, _, rows, _, spacing, _ in tensors:
+    offsets.append(offset)
+    offset = align(offset + rows * spacing * 4, ALIGNMENT)
+
+header = MAGIC + struct.pack('<Q', len(tensors))
+for (name, transposed, rows, cols, spacing, _), offset in zip(tensors, offsets):
+    header += struct.pack('<Q', len(name)) + name
+    header += struct.pack('<6Q', FLOAT32, transposed, rows, cols, spacing, offset)
+
+with open(args.output, 'wb') as out:
+    out.write(header)
+    for (_, _, rows, cols, spacing, array), offset in zip(tensors, offsets):
+        out.write(b'\0' * (offset - out.tell()))
+        padded = np.zeros((rows, spacing), dtype='<f4')
+        padded[:, :cols] = array
+        out.write(padded.tobytes())
+
+print("Wrote {} tensors to {}".format(len(tensors), args.output))
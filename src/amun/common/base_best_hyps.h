@@ -27,12 +27,37 @@ class BestHypsBase
 
     BestHypsBase(const BestHypsBase&) = delete;
 
+    // Selects beamSizes[i] candidates for each sentence i. Rows of the scorers'
+    // output are grouped by sentence, rowSizes[i] rows for sentence i.
     virtual void CalcBeam(
         const Beam& prevHyps,
         const std::vector<ScorerPtr>& scorers,
         const Words& filterIndices,
         std::vector<Beam>& beams,
-        std::vector<uint>& beamSizes) = 0;
+        std::vector<uint>& beamSizes,
+        const std::vector<uint>& rowSizes) = 0;
+
+    // Greedy search: best word of every row of the scorers' output and its
+    // weighted score, without the previous cost.
+    virtual void CalcArgmax(
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        Words& words,
+        std::vector<float>& costs)
+    {
+      size_t rows = scorers[0]->GetProbs().dim(0);
+      Beam prevHyps(rows, HypothesisPtr(new Hypothesis()));
+      std::vector<Beam> beams(rows);
+      std::vector<uint> beamSizes(rows, 1);
+      CalcBeam(prevHyps, scorers, filterIndices, beams, beamSizes, beamSizes);
+
+      words.clear();
+      costs.clear();
+      for (auto& beam : beams) {
+        words.push_back(beam[0]->GetWord());
+        costs.push_back(beam[0]->GetCost());
+      }
+    }
 
   protected:
     const bool forbidUNK_;
@@ -112,6 +112,18 @@ void Validate(const YAML::Node& config) {
   amunmt_UTIL_THROW_IF2(config["maxi-batch"].as<int>() < config["mini-batch"].as<int>(),
                 "maxi-batch (" << config["maxi-batch"].as<int>()
                 << ") < mini-batch (" << config["mini-batch"].as<int>() << ")");
+
+  amunmt_UTIL_THROW_IF2(config["max-length-factor"].as<float>() <= 0,
+                "max-length-factor must be positive");
+
+  amunmt_UTIL_THROW_IF2(config["prune-relative"].as<float>() < 0 || config["prune-relative"].as<float>() > 1,
+                "prune-relative must be between 0 and 1");
+
+#ifdef HAS_CPU
+  std::string precision = config["weight-precision"].as<std::string>();
+  amunmt_UTIL_THROW_IF2(precision != "fp32" && precision != "fp16" && precision != "bf16",
+                "weight-precision must be fp32, fp16 or bf16");
+#endif
 }
 
 void OutputRec(const YAML::Node node, YAML::Emitter& out) {
@@ -209,6 +221,26 @@ void Config::AddOptions(size_t argc, char** argv) {
      ("cpu-threads", po::value<size_t>()->default_value(1),
       "Number of threads on the CPU.")
   #endif
+    ("parallel-encoder", po::value<bool>()->zero_tokens()->default_value(false),
+     "Run the forward and backward encoder passes concurrently, using one more "
+     "core per CPU thread (Nematus models)")
+    ("fused-readout", po::value<bool>()->zero_tokens()->default_value(false),
+     "Compute the readout layer of models without layer normalisation as one "
+     "matrix product over the concatenated decoder inputs")
+    ("int8", po::value<bool>()->zero_tokens()->default_value(false),
+     "Replace the decoder GRU weights and the output layer by int8 copies, "
+     "quantising activations on the fly. Check the BLEU cost per model with "
+     "scripts/int8_bleu.py")
+    ("weight-precision", po::value<std::string>()->default_value("fp32"),
+     "Storage of the embeddings and the output layer: fp32, or fp16/bf16 for half "
+     "the memory, converted back to fp32 block by block inside the matrix products")
+    ("embedding-tables", po::value<size_t>()->default_value(0),
+     "Memory budget in MB per model for tables of the decoder's first projections "
+     "of each target embedding, looked up by word id instead of computed per step. "
+     "0 disables them")
+    ("embedding-table-words", po::value<size_t>()->default_value(0),
+     "Only tabulate the first N (most frequent) target words, 0 for the whole "
+     "vocabulary. Other words are projected per step")
 #endif
 
 #ifdef HAS_FPGA
@@ -262,6 +294,18 @@ void Config::AddOptions(size_t argc, char** argv) {
      "Allow generation of UNK")
     ("n-best", po::value<bool>()->zero_tokens()->default_value(false),
      "Output n-best list with n = beam-size")
+    ("max-length-factor", po::value<float>()->default_value(3.0f),
+     "Maximum target length as a multiple of the source sentence length")
+    ("early-stopping", po::value<bool>()->zero_tokens()->default_value(false),
+     "Stop searching a sentence once no unfinished hypothesis can beat the best "
+     "finished one (or enter the n-best list)")
+    ("prune-absolute", po::value<float>()->default_value(0.0f),
+     "Drop candidates scoring more than this below the best one of their sentence, 0=off")
+    ("prune-relative", po::value<float>()->default_value(0.0f),
+     "Drop candidates whose probability is below this fraction of the best one of "
+     "their sentence, 0=off")
+    ("prune-max-per-parent", po::value<size_t>()->default_value(0),
+     "Keep at most this many candidates extending the same hypothesis, 0=off")
   ;
 
   po::options_description configuration("Configuration meta options");
@@ -308,6 +352,11 @@ void Config::AddOptions(size_t argc, char** argv) {
   // Simple overwrites
   SET_OPTION("n-best", bool);
   SET_OPTION("normalize", bool);
+  SET_OPTION("max-length-factor", float);
+  SET_OPTION("early-stopping", bool);
+  SET_OPTION("prune-absolute", float);
+  SET_OPTION("prune-relative", float);
+  SET_OPTION("prune-max-per-parent", size_t);
   SET_OPTION("wipo", bool);
   SET_OPTION("return-alignment", bool);
   SET_OPTION("return-soft-alignment", bool);
@@ -326,6 +375,12 @@ void Config::AddOptions(size_t argc, char** argv) {
 #endif
 #ifdef HAS_CPU
   SET_OPTION("cpu-threads", size_t);
+  SET_OPTION("parallel-encoder", bool);
+  SET_OPTION("fused-readout", bool);
+  SET_OPTION("int8", bool);
+  SET_OPTION("weight-precision", std::string);
+  SET_OPTION("embedding-tables", size_t);
+  SET_OPTION("embedding-table-words", size_t);
 #endif
 #ifdef HAS_FPGA
   SET_OPTION("fpga-threads", size_t);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace amunmt {
+
+// Runs two tasks at once, one on a helper thread and one on the caller.
+// Meant for splitting work inside a single translation: the helper is
+// started once and only woken up per call, unlike a ThreadPool task.
+class ForkJoin {
+  public:
+    ForkJoin()
+      : hasTask_(false),
+        stop_(false),
+        helper_([this] { Work(); })
+    {}
+
+    ForkJoin(const ForkJoin&) = delete;
+
+    ~ForkJoin() {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      condition_.notify_all();
+      helper_.join();
+    }
+
+    // Returns once both are done. An exception of either task is rethrown.
+    void Run(const std::function<void()>& forked, const std::function<void()>& local) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ = forked;
+        error_ = nullptr;
+        hasTask_ = true;
+      }
+      condition_.notify_all();
+
+      std::exception_ptr localError;
+      try {
+        local();
+      } catch (...) {
+        localError = std::current_exception();
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this] { return !hasTask_; });
+      if (localError) {
+        std::rethrow_exception(localError);
+      }
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+    }
+
+  private:
+    void Work() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;) {
+        condition_.wait(lock, [this] { return stop_ || hasTask_; });
+        if (stop_) {
+          return;
+        }
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+          task_();
+        } catch (...) {
+          error = std::current_exception();
+        }
+        lock.lock();
+
+        error_ = error;
+        hasTask_ = false;
+        condition_.notify_all();
+      }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::function<void()> task_;
+    std::exception_ptr error_;
+    bool hasTask_;
+    bool stop_;
+    // last, so that everything above exists when it starts
+    std::thread helper_;
+};
+
+}
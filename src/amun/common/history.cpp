@@ -4,22 +4,30 @@
 
 namespace amunmt {
 
-History::History(size_t lineNo, bool normalizeScore, size_t maxLength)
+History::History(size_t lineNo, bool normalizeScore, size_t maxLength, size_t earlyStopNBest)
   : normalize_(normalizeScore),
     lineNo_(lineNo),
-   maxLength_(maxLength)
+   maxLength_(maxLength),
+   earlyStopNBest_(earlyStopNBest),
+   finished_(false)
 {
-  Add({HypothesisPtr(new Hypothesis())});
+  words_.push_back(0);
+  prevIds_.push_back(0);
+  costs_.push_back(0.0f);
+  slots_.emplace_back();
 }
 
 
-Histories::Histories(const Sentences& sentences, bool normalizeScore)
+Histories::Histories(const Sentences& sentences, bool normalizeScore,
+                     float maxLengthFactor, size_t earlyStopNBest)
  : coll_(sentences.size())
 {
   for (size_t i = 0; i < sentences.size(); ++i) {
     const Sentence &sentence = *sentences.at(i).get();
-    History *history = new History(sentence.GetLineNum(), normalizeScore, 3 * sentence.size());
+    size_t maxLength = std::max<size_t>(1, maxLengthFactor * sentence.size());
+    History *history = new History(sentence.GetLineNum(), normalizeScore, maxLength, earlyStopNBest);
     coll_[i].reset(history);
+    maxLength_ = std::max(maxLength_, maxLength);
   }
 }
 
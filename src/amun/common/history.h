@@ -1,7 +1,9 @@
 #pragma once
 
 #include <queue>
+#include <limits>
 #include <algorithm>
+#include <functional>
 
 #include "hypothesis.h"
 
@@ -16,54 +18,59 @@ class History {
         return cost < hc.cost;
       }
 
-      size_t i;
-      size_t j;
+      size_t id;
       float cost;
     };
 
     History(const History&) = delete;
 
   public:
-    History(size_t lineNo, bool normalizeScore, size_t maxLength);
+    History(size_t lineNo, bool normalizeScore, size_t maxLength, size_t earlyStopNBest = 0);
 
     void Add(const Beam& beam) {
-      if (beam.back()->GetPrevHyp() != nullptr) {
-        for (size_t j = 0; j < beam.size(); ++j)
-          if(beam[j]->GetWord() == EOS_ID || size() == maxLength_ ) {
-            float cost = normalize_ ? beam[j]->GetCost() / history_.size() : beam[j]->GetCost();
-            topHyps_.push({ history_.size(), j, cost });
-          }
+      bool hasLive = false;
+      float bestLiveCost = std::numeric_limits<float>::lowest();
+      for (auto& hyp : beam) {
+        size_t id = AddToTrace(hyp);
+        if(hyp->GetWord() == EOS_ID || hyp->GetLength() == maxLength_ ) {
+          float cost = normalize_ ? hyp->GetCost() / hyp->GetLength() : hyp->GetCost();
+          topHyps_.push({ id, cost });
+          AddFinishedCost(cost);
+        } else {
+          hasLive = true;
+          bestLiveCost = std::max(bestLiveCost, hyp->GetCost());
+        }
       }
-      history_.push_back(beam);
+
+      finished_ = !hasLive || CannotImprove(bestLiveCost);
     }
 
-    size_t size() const {
-      return history_.size();
+    // True once the search for this sentence can stop: no hypotheses are left
+    // or, with early stopping, none of them can enter the n-best list any more.
+    bool IsFinished() const {
+      return finished_;
+    }
+
+    size_t GetMaxLength() const {
+      return maxLength_;
     }
 
-    Beam& front() {
-      return history_.front();
+    // Greedy search keeps no beams and stores its single result directly.
+    void SetResult(const Words& words, float cost) {
+      HypothesisPtr hyp(new Hypothesis(nullptr, words.back(), 0, cost));
+      result_.emplace_back(words, hyp);
     }
 
     NBestList NBest(size_t n) const {
+      if (!result_.empty()) {
+        return result_;
+      }
+
       NBestList nbest;
       auto topHypsCopy = topHyps_;
       while (nbest.size() < n && !topHypsCopy.empty()) {
-        auto bestHypCoord = topHypsCopy.top();
+        nbest.push_back(Backtrace(topHypsCopy.top().id));
         topHypsCopy.pop();
-
-        size_t start = bestHypCoord.i;
-        size_t j  = bestHypCoord.j;
-
-        Words targetWords;
-        HypothesisPtr bestHyp = history_[start][j];
-        while(bestHyp->GetPrevHyp() != nullptr) {
-          targetWords.push_back(bestHyp->GetWord());
-          bestHyp = bestHyp->GetPrevHyp();
-        }
-
-        std::reverse(targetWords.begin(), targetWords.end());
-        nbest.emplace_back(targetWords, history_[bestHypCoord.i][bestHypCoord.j]);
       }
       return nbest;
     }
@@ -76,18 +83,106 @@ class History {
     { return lineNo_; }
 
   private:
-    std::vector<Beam> history_;
+    size_t AddToTrace(const HypothesisPtr& hyp) {
+      size_t id = words_.size();
+      words_.push_back(hyp->GetWord());
+      prevIds_.push_back(hyp->prevId_);
+      costs_.push_back(hyp->GetCost());
+      if (const float* scores = hyp->GetStepScores()) {
+        numScorers_ = hyp->stepScores_->numScorers;
+        stepScores_.resize(id * numScorers_);
+        stepScores_.insert(stepScores_.end(), scores, scores + numScorers_);
+      }
+      if (!hyp->HasAlignments() && hyp->GetCostBreakdown().empty()) {
+        slots_.emplace_back();
+      } else {
+        slots_.push_back(hyp);
+      }
+      hyp->id_ = id;
+      return id;
+    }
+
+    // Words of trace entry id and its hypothesis, linked to freshly built
+    // predecessors so that the GetPrevHyp() chain can be walked.
+    Result Backtrace(size_t id) const {
+      std::vector<size_t> path;
+      for (size_t i = id; i != 0; i = prevIds_[i]) {
+        path.push_back(i);
+      }
+
+      Words words;
+      HypothesisPtr hyp(new Hypothesis());
+      for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        HypothesisPtr next(slots_[*it] ? new Hypothesis(*slots_[*it])
+                                       : new Hypothesis(hyp, words_[*it], 0, costs_[*it]));
+        next->prevHyp_ = hyp;
+        words.push_back(words_[*it]);
+        hyp = next;
+      }
+
+      if (numScorers_ > 0) {
+        hyp->costBreakdown_.assign(numScorers_, 0.0f);
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+          if ((*it + 1) * numScorers_ <= stepScores_.size()) {
+            for (size_t j = 0; j < numScorers_; ++j) {
+              hyp->costBreakdown_[j] += stepScores_[*it * numScorers_ + j];
+            }
+          }
+        }
+      }
+      return Result(words, hyp);
+    }
+
+  private:
+    void AddFinishedCost(float cost) {
+      if (earlyStopNBest_ == 0) {
+        return;
+      }
+      finishedCosts_.push(cost);
+      if (finishedCosts_.size() > earlyStopNBest_) {
+        finishedCosts_.pop();
+      }
+    }
+
+    // Hypothesis costs are sums of log-probabilities and never increase, so a
+    // live hypothesis ends with at most its current cost, and with at most
+    // cost / maxLength_ when scores are normalised by length.
+    bool CannotImprove(float bestLiveCost) const {
+      if (earlyStopNBest_ == 0 || finishedCosts_.size() < earlyStopNBest_ || bestLiveCost > 0) {
+        return false;
+      }
+      float bound = normalize_ ? bestLiveCost / maxLength_ : bestLiveCost;
+      return bound <= finishedCosts_.top();
+    }
+
+    // trace of all hypotheses of the sentence, entry 0 is the empty start
+    std::vector<Word> words_;
+    std::vector<size_t> prevIds_;
+    std::vector<float> costs_;
+    // the hypothesis itself, kept only if it carries alignments or cost breakdowns
+    std::vector<HypothesisPtr> slots_;
+    // per-scorer step scores of each entry, summed up for n-best results only
+    std::vector<float> stepScores_;
+    size_t numScorers_ = 0;
+
     std::priority_queue<HypothesisCoord> topHyps_;
+    NBestList result_;
     bool normalize_;
     size_t lineNo_;
     size_t maxLength_;
+
+    size_t earlyStopNBest_;
+    // the earlyStopNBest_ best finished costs, worst on top
+    std::priority_queue<float, std::vector<float>, std::greater<float>> finishedCosts_;
+    bool finished_;
 };
 
 
 class Histories {
   public:
     Histories() {} // for all histories in translation task
-    Histories(const Sentences& sentences, bool normalizeScore);
+    Histories(const Sentences& sentences, bool normalizeScore,
+              float maxLengthFactor = 3.0f, size_t earlyStopNBest = 0);
 
     std::shared_ptr<History> at(size_t id) const {
       return coll_.at(id);
@@ -97,6 +192,11 @@ class Histories {
       return coll_.size();
     }
 
+    // longest target length allowed for any sentence of the batch
+    size_t GetMaxLength() const {
+      return maxLength_;
+    }
+
     void Add(const Beams& beams) {
       for (size_t i = 0; i < size(); ++i) {
         if (!beams[i].empty()) {
@@ -110,14 +210,15 @@ class Histories {
 
     Beam GetFirstHyps() {
       Beam beam;
-      for (auto& history : coll_) {
-        beam.emplace_back(history->front()[0]);
+      for (size_t i = 0; i < coll_.size(); ++i) {
+        beam.emplace_back(new Hypothesis());
       }
       return beam;
     }
 
   protected:
     std::vector<std::shared_ptr<History>> coll_;
+    size_t maxLength_ = 0;
     Histories(const Histories &) = delete;
 };
 
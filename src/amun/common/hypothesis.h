@@ -9,17 +9,34 @@ class Hypothesis;
 
 typedef std::shared_ptr<Hypothesis> HypothesisPtr;
 
+// Unweighted scores of every scorer for the candidates selected in one step,
+// numScorers values per candidate, shared by the hypotheses of that step.
+struct StepScores {
+  std::vector<float> scores;
+  size_t numScorers;
+};
+
+typedef std::shared_ptr<const StepScores> StepScoresPtr;
+
+// A search candidate. The search only links it to its predecessor by index
+// into the sentence's History trace (see History::Add), so a live hypothesis
+// does not keep its ancestors alive. Full GetPrevHyp() chains exist only for
+// results returned by History::NBest.
 class Hypothesis {
   public:
     Hypothesis()
-     : prevHyp_(nullptr),
+     : prevId_(0),
+       id_(0),
+       length_(0),
        prevIndex_(0),
        word_(0),
        cost_(0.0)
     {}
 
     Hypothesis(const HypothesisPtr prevHyp, size_t word, size_t prevIndex, float cost)
-      : prevHyp_(prevHyp),
+      : prevId_(prevHyp ? prevHyp->id_ : 0),
+        id_(0),
+        length_(prevHyp ? prevHyp->length_ + 1 : 1),
         prevIndex_(prevIndex),
         word_(word),
         cost_(cost)
@@ -27,17 +44,35 @@ class Hypothesis {
 
     Hypothesis(const HypothesisPtr prevHyp, size_t word, size_t prevIndex, float cost,
                std::vector<SoftAlignmentPtr> alignment)
-      : prevHyp_(prevHyp),
+      : prevId_(prevHyp ? prevHyp->id_ : 0),
+        id_(0),
+        length_(prevHyp ? prevHyp->length_ + 1 : 1),
         prevIndex_(prevIndex),
         word_(word),
         cost_(cost),
         alignments_(alignment)
     {}
 
+    Hypothesis(const HypothesisPtr prevHyp, size_t word, size_t prevIndex, float cost,
+               std::vector<AlignmentRef> alignmentRefs)
+      : prevId_(prevHyp ? prevHyp->id_ : 0),
+        id_(0),
+        length_(prevHyp ? prevHyp->length_ + 1 : 1),
+        prevIndex_(prevIndex),
+        word_(word),
+        cost_(cost),
+        alignmentRefs_(alignmentRefs)
+    {}
+
     const HypothesisPtr GetPrevHyp() const {
       return prevHyp_;
     }
 
+    // number of words, 0 for the empty start hypothesis
+    size_t GetLength() const {
+      return length_;
+    }
+
     size_t GetWord() const {
       return word_;
     }
@@ -50,26 +85,57 @@ class Hypothesis {
       return cost_;
     }
 
+    // per-scorer totals, filled in for hypotheses returned by History::NBest
     std::vector<float>& GetCostBreakdown() {
       return costBreakdown_;
     }
 
+    void SetStepScores(StepScoresPtr stepScores, size_t row) {
+      stepScores_ = stepScores;
+      stepScoresRow_ = row;
+    }
+
+    // scores of the last word only, nullptr unless n-best lists are requested
+    const float* GetStepScores() const {
+      return stepScores_ ? stepScores_->scores.data() + stepScoresRow_ * stepScores_->numScorers
+                         : nullptr;
+    }
+
+    bool HasAlignments() const {
+      return !alignments_.empty() || !alignmentRefs_.empty();
+    }
+
     SoftAlignmentPtr GetAlignment(size_t i) {
-      return alignments_[i];
+      return GetAlignments()[i];
     }
 
     std::vector<SoftAlignmentPtr>& GetAlignments() {
+      if (alignments_.empty()) {
+        for (auto& ref : alignmentRefs_) {
+          alignments_.push_back(ref.Get());
+        }
+      }
       return alignments_;
     }
 
   private:
-    const HypothesisPtr prevHyp_;
-    const size_t prevIndex_;
-    const size_t word_;
-    const float cost_;
+    friend class History;
+
+    HypothesisPtr prevHyp_;
+    // positions in the History trace
+    size_t prevId_;
+    size_t id_;
+    size_t length_;
+
+    size_t prevIndex_;
+    size_t word_;
+    float cost_;
     std::vector<SoftAlignmentPtr> alignments_;
+    std::vector<AlignmentRef> alignmentRefs_;
 
     std::vector<float> costBreakdown_;
+    StepScoresPtr stepScores_;
+    size_t stepScoresRow_ = 0;
 };
 
 typedef std::vector<HypothesisPtr> Beam;
@@ -9,4 +9,14 @@ Scorer::Scorer(const God &god,
 {
 }
 
+void Scorer::AssembleGreedyState(State& in, const std::vector<size_t>& rows,
+                                 const Words& words, State& out)
+{
+  Beam beam;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    beam.emplace_back(new Hypothesis(nullptr, words[i], rows[i], 0.0f));
+  }
+  AssembleBeamState(in, beam, out);
+}
+
 }
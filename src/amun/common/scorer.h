@@ -49,6 +49,12 @@ class Scorer {
 
     virtual void AssembleBeamState(const State& in, const Beam& beam, State& out) = 0;
 
+    // Greedy search: out continues from rows of in (one per live sentence) with
+    // the given words. Scorers may move the rows instead of copying them, so in
+    // is no longer valid afterwards.
+    virtual void AssembleGreedyState(State& in, const std::vector<size_t>& rows,
+                                     const Words& words, State& out);
+
     virtual void Encode(const Sentences& sources) = 0;
 
     virtual void Filter(const std::vector<size_t>&) = 0;
@@ -1,3 +1,6 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <boost/timer/timer.hpp>
 #include "common/search.h"
 #include "common/sentences.h"
@@ -16,6 +19,15 @@ Search::Search(const God &god)
     filter_(god.GetFilter()),
     maxBeamSize_(god.Get<size_t>("beam-size")),
     normalizeScore_(god.Get<bool>("normalize")),
+    maxLengthFactor_(god.Get<float>("max-length-factor")),
+    earlyStopNBest_(!god.Get<bool>("early-stopping") ? 0 :
+                    god.Get<bool>("n-best") ? maxBeamSize_ : 1),
+    pruneAbsolute_(god.Get<float>("prune-absolute")),
+    pruneRelative_(god.Get<float>("prune-relative")),
+    pruneMaxPerParent_(god.Get<size_t>("prune-max-per-parent")),
+    greedy_(maxBeamSize_ == 1 && !god.Get<bool>("n-best") &&
+            !god.Get<bool>("return-alignment") && !god.Get<bool>("return-soft-alignment") &&
+            !god.Get<bool>("return-nematus-alignment")),
     bestHyps_(god.GetBestHyps(deviceInfo_))
 {}
 
@@ -36,6 +48,10 @@ void Search::CleanAfterTranslation()
 }
 
 std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
+  if (greedy_) {
+    return TranslateGreedy(sentences);
+  }
+
   boost::timer::cpu_timer timer;
 
   if (filter_) {
@@ -44,27 +60,100 @@ std::shared_ptr<Histories> Search::Translate(const Sentences& sentences) {
 
   States states = Encode(sentences);
   States nextStates = NewStates();
-  std::vector<uint> beamSizes(sentences.size(), 1);
+  // candidates selected per sentence and rows of live decoder state per sentence
+  std::vector<uint> beamSizes(sentences.size(), maxBeamSize_);
+  std::vector<uint> rowSizes(sentences.size(), 1);
 
-  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_));
+  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_,
+                                                     maxLengthFactor_, earlyStopNBest_));
   Beam prevHyps = histories->GetFirstHyps();
 
-  for (size_t decoderStep = 0; decoderStep < 3 * sentences.GetMaxLength(); ++decoderStep) {
+  for (size_t decoderStep = 0; decoderStep < histories->GetMaxLength(); ++decoderStep) {
+    for (size_t i = 0; i < scorers_.size(); i++) {
+      scorers_[i]->Decode(*states[i], *nextStates[i], rowSizes);
+    }
+    //cerr << "beamSizes=" << Debug(beamSizes, 1) << endl;
+
+    bool hasSurvivors = CalcBeam(histories, beamSizes, rowSizes, prevHyps, states, nextStates);
+    if (!hasSurvivors) {
+      break;
+    }
+  }
+
+  CleanAfterTranslation();
+
+  LOG(progress)->info("Search took {}", timer.format(3, "%ws"));
+  return histories;
+}
+
+std::shared_ptr<Histories> Search::TranslateGreedy(const Sentences& sentences) {
+  boost::timer::cpu_timer timer;
+
+  if (filter_) {
+    FilterTargetVocab(sentences);
+  }
+
+  States states = Encode(sentences);
+  States nextStates = NewStates();
+
+  size_t batchSize = sentences.size();
+  std::vector<uint> beamSizes(batchSize, 1);
+
+  std::shared_ptr<Histories> histories(new Histories(sentences, normalizeScore_, maxLengthFactor_));
+  const size_t maxLength = histories->GetMaxLength();
+
+  // output words of sentence i are kept at [i * maxLength, i * maxLength + lengths[i])
+  Words output(batchSize * maxLength);
+  std::vector<size_t> lengths(batchSize, 0);
+  std::vector<float> totalCosts(batchSize, 0.0f);
+
+  // decoder row -> sentence
+  std::vector<size_t> live(batchSize);
+  for (size_t i = 0; i < batchSize; ++i) {
+    live[i] = i;
+  }
+
+  Words words, nextWords;
+  std::vector<float> costs;
+  std::vector<size_t> rows, nextLive;
+
+  for (size_t decoderStep = 0; decoderStep < maxLength; ++decoderStep) {
     for (size_t i = 0; i < scorers_.size(); i++) {
       scorers_[i]->Decode(*states[i], *nextStates[i], beamSizes);
     }
 
-    if (decoderStep == 0) {
-      for (auto& beamSize : beamSizes) {
-        beamSize = maxBeamSize_;
+    bestHyps_->CalcArgmax(scorers_, filterIndices_, words, costs);
+
+    rows.clear();
+    nextWords.clear();
+    nextLive.clear();
+    for (size_t row = 0; row < live.size(); ++row) {
+      size_t batchId = live[row];
+      output[batchId * maxLength + lengths[batchId]++] = words[row];
+      totalCosts[batchId] += costs[row];
+
+      if (words[row] == EOS_ID || lengths[batchId] == histories->at(batchId)->GetMaxLength()) {
+        beamSizes[batchId] = 0;
+      } else {
+        rows.push_back(row);
+        nextWords.push_back(words[row]);
+        nextLive.push_back(batchId);
       }
     }
-    //cerr << "beamSizes=" << Debug(beamSizes, 1) << endl;
 
-    bool hasSurvivors = CalcBeam(histories, beamSizes, prevHyps, states, nextStates);
-    if (!hasSurvivors) {
+    if (rows.empty()) {
       break;
     }
+
+    for (size_t i = 0; i < scorers_.size(); i++) {
+      scorers_[i]->AssembleGreedyState(*nextStates[i], rows, nextWords, *states[i]);
+    }
+    live.swap(nextLive);
+  }
+
+  for (size_t i = 0; i < batchSize; ++i) {
+    Words result(output.begin() + i * maxLength, output.begin() + i * maxLength + lengths[i]);
+    histories->at(i)->SetResult(result, totalCosts[i]);
   }
 
   CleanAfterTranslation();
@@ -87,20 +176,38 @@ States Search::Encode(const Sentences& sentences) {
 bool Search::CalcBeam(
     std::shared_ptr<Histories>& histories,
     std::vector<uint>& beamSizes,
+    std::vector<uint>& rowSizes,
     Beam& prevHyps,
     States& states,
     States& nextStates)
 {
     size_t batchSize = beamSizes.size();
     Beams beams(batchSize);
-    bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes);
+    bestHyps_->CalcBeam(prevHyps, scorers_, filterIndices_, beams, beamSizes, rowSizes);
+
+    if (pruneAbsolute_ > 0 || pruneRelative_ > 0 || pruneMaxPerParent_ > 0) {
+      bool isFirst = (prevHyps[0]->GetLength() == 0);
+      parentCounts_.assign(prevHyps.size(), 0);
+      for (auto& beam : beams) {
+        PruneBeam(beam, isFirst);
+      }
+    }
     histories->Add(beams);
 
+    // finished hypotheses shrink the beam for good, pruned ones only leave
+    // fewer rows of state for the next step
     Beam survivors;
     for (size_t batchId = 0; batchId < batchSize; ++batchId) {
+      rowSizes[batchId] = 0;
+      if (histories->at(batchId)->IsFinished()) {
+        beamSizes[batchId] = 0;
+        continue;
+      }
+
       for (auto& h : beams[batchId]) {
         if (h->GetWord() != EOS_ID) {
           survivors.push_back(h);
+          ++rowSizes[batchId];
         } else {
           --beamSizes[batchId];
         }
@@ -120,6 +227,49 @@ bool Search::CalcBeam(
 }
 
 
+void Search::PruneBeam(Beam& beam, bool isFirst) {
+  if (beam.empty()) {
+    return;
+  }
+
+  // best first; ties keep the order of BestHyps, by parent row and then word
+  std::sort(beam.begin(), beam.end(),
+            [](const HypothesisPtr& a, const HypothesisPtr& b) {
+              if (a->GetCost() != b->GetCost()) {
+                return a->GetCost() > b->GetCost();
+              }
+              if (a->GetPrevStateIndex() != b->GetPrevStateIndex()) {
+                return a->GetPrevStateIndex() < b->GetPrevStateIndex();
+              }
+              return a->GetWord() < b->GetWord();
+            });
+
+  float best = beam[0]->GetCost();
+  float threshold = std::numeric_limits<float>::lowest();
+  if (pruneAbsolute_ > 0) {
+    threshold = std::max(threshold, best - pruneAbsolute_);
+  }
+  if (pruneRelative_ > 0) {
+    threshold = std::max(threshold, best + std::log(pruneRelative_));
+  }
+
+  // all first-step candidates extend the same start hypothesis, so the
+  // per-parent limit would collapse the beam for good
+  size_t maxPerParent = isFirst ? 0 : pruneMaxPerParent_;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < beam.size(); ++i) {
+    if (beam[i]->GetCost() < threshold) {
+      break;
+    }
+    if (maxPerParent && ++parentCounts_[beam[i]->GetPrevStateIndex()] > maxPerParent) {
+      continue;
+    }
+    std::swap(beam[kept++], beam[i]);
+  }
+  beam.resize(kept);
+}
+
 States Search::NewStates() const {
   States states;
   for (auto& scorer : scorers_) {
@@ -25,13 +25,21 @@ class Search {
     States Encode(const Sentences& sentences);
     void CleanAfterTranslation();
 
+    std::shared_ptr<Histories> TranslateGreedy(const Sentences& sentences);
+
     bool CalcBeam(
     		std::shared_ptr<Histories>& histories,
     		std::vector<uint>& beamSizes,
+    		std::vector<uint>& rowSizes,
         Beam& prevHyps,
     		States& states,
     		States& nextStates);
 
+    // Drops candidates too far below the best one of their sentence and those
+    // exceeding the per-parent limit. Only this step's beam shrinks; the next
+    // step selects the full number of candidates again.
+    void PruneBeam(Beam& beam, bool isFirst);
+
     Search(const Search&) = delete;
 
   protected:
@@ -40,8 +48,17 @@ class Search {
     std::shared_ptr<const Filter> filter_;
     const size_t maxBeamSize_;
     bool normalizeScore_;
+    float maxLengthFactor_;
+    size_t earlyStopNBest_;
+    float pruneAbsolute_;
+    float pruneRelative_;
+    size_t pruneMaxPerParent_;
+    bool greedy_;
     Words filterIndices_;
     BestHypsBasePtr bestHyps_;
+
+    // candidates kept per row of the previous beam, reused by PruneBeam
+    std::vector<size_t> parentCounts_;
 };
 
 }
@@ -11,3 +11,25 @@ using SoftAlignment = std::vector<float>;
 #endif
 
 using SoftAlignmentPtr = std::shared_ptr<SoftAlignment>;
+
+// Attention weights of one decoder step, rows of `columns` weights, shared by
+// all hypotheses created in that step.
+struct StepAlignment {
+  SoftAlignment weights;
+  size_t columns;
+};
+
+using StepAlignmentPtr = std::shared_ptr<const StepAlignment>;
+
+// The first `length` weights of one row of a StepAlignment. Only copied into
+// a SoftAlignment when the alignment is actually requested.
+struct AlignmentRef {
+  StepAlignmentPtr step;
+  size_t row;
+  size_t length;
+
+  SoftAlignmentPtr Get() const {
+    auto begin = step->weights.begin() + row * step->columns;
+    return SoftAlignmentPtr(new SoftAlignment(begin, begin + length));
+  }
+};
@@ -19,7 +19,7 @@ void TranslationTaskAndOutput(const God &god, std::shared_ptr<Sentences> sentenc
   for (size_t i = 0; i < histories->size(); ++i) {
     const History &history = *histories->at(i);
     size_t lineNum = history.GetLineNum();
-	const Sentence &sentence = *sentences->at(0);
+    const Sentence &sentence = *sentences->at(i);
 
     std::stringstream strm;
     Printer(god, history, strm, sentence);
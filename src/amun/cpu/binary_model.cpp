@@ -0,0 +1,188 @@
+#include "cpu/binary_model.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/exception.h"
+
+namespace amunmt {
+namespace CPU {
+
+namespace {
+
+const char MAGIC[8] = {'A', 'M', 'U', 'N', 'B', 'I', 'N', '1'};
+const size_t ALIGNMENT = 64;  // bytes, of tensor offsets
+const size_t PADDING = 16;    // floats, float32 rows are padded to a multiple of this
+
+// Reads the header fields one by one, checking that they are in the file
+class HeaderReader {
+  public:
+    HeaderReader(const char* data, size_t size, const std::string& file)
+      : data_(data), size_(size), pos_(0), file_(file)
+    {}
+
+    const char* Read(size_t bytes) {
+      amunmt_UTIL_THROW_IF2(bytes > size_ - pos_, "Truncated header in " << file_);
+      const char* ret = data_ + pos_;
+      pos_ += bytes;
+      return ret;
+    }
+
+    uint64_t ReadUInt() {
+      uint64_t ret;
+      std::memcpy(&ret, Read(sizeof(ret)), sizeof(ret));
+      return ret;
+    }
+
+  private:
+    const char* data_;
+    size_t size_;
+    size_t pos_;
+    const std::string& file_;
+};
+
+size_t Align(size_t value) {
+  return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+void WriteUInt(std::ofstream& out, uint64_t value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+size_t ElementSize(BinaryModel::Type type) {
+  switch (type) {
+    case BinaryModel::Float32: return sizeof(float);
+    case BinaryModel::Float16:
+    case BinaryModel::BFloat16: return sizeof(uint16_t);
+  }
+  return 0;
+}
+
+}
+
+bool BinaryModel::IsBinary(const std::string& file) {
+  std::ifstream in(file, std::ios::binary);
+  char magic[sizeof(MAGIC)];
+  return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+BinaryModel::BinaryModel(const std::string& file)
+  : data_(nullptr), size_(0)
+{
+  int fd = open(file.c_str(), O_RDONLY);
+  amunmt_UTIL_THROW_IF2(fd == -1, "Cannot open " << file);
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    amunmt_UTIL_THROW2("Cannot read " << file);
+  }
+  size_ = st.st_size;
+  data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  amunmt_UTIL_THROW_IF2(data_ == MAP_FAILED, "Cannot map " << file);
+
+  const char* begin = static_cast<const char*>(data_);
+  HeaderReader header(begin, size_, file);
+  amunmt_UTIL_THROW_IF2(std::memcmp(header.Read(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)) != 0,
+                        file << " is not an amun binary model");
+
+  size_t count = header.ReadUInt();
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = header.ReadUInt();
+    std::string name(header.Read(length), length);
+
+    Tensor tensor;
+    tensor.type = static_cast<Type>(header.ReadUInt());
+    tensor.transposed = header.ReadUInt() != 0;
+    tensor.rows = header.ReadUInt();
+    tensor.cols = header.ReadUInt();
+    tensor.spacing = header.ReadUInt();
+    size_t offset = header.ReadUInt();
+
+    size_t elementSize = ElementSize(tensor.type);
+    amunmt_UTIL_THROW_IF2(elementSize == 0, "Unknown type of " << name << " in " << file);
+    amunmt_UTIL_THROW_IF2(tensor.spacing < tensor.cols || offset % ALIGNMENT != 0,
+                          "Bad layout of " << name << " in " << file);
+    amunmt_UTIL_THROW_IF2(offset > size_
+                          || tensor.rows * tensor.spacing * elementSize > size_ - offset,
+                          name << " extends past the end of " << file);
+    tensor.data = begin + offset;
+    tensors_[name] = tensor;
+  }
+}
+
+BinaryModel::~BinaryModel() {
+  munmap(data_, size_);
+}
+
+const BinaryModel::Tensor* BinaryModel::find(const std::string& name) const {
+  auto it = tensors_.find(name);
+  return it != tensors_.end() ? &it->second : nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void BinaryModelWriter::Add(const std::string& name, const float* data, size_t rows,
+                            size_t cols, size_t stride, bool transposed) {
+  size_t spacing = (cols + PADDING - 1) / PADDING * PADDING;
+  entries_.push_back({name, BinaryModel::Float32, transposed, rows, cols, spacing,
+                      stride * sizeof(float), reinterpret_cast<const char*>(data)});
+}
+
+void BinaryModelWriter::Add(const std::string& name, const uint16_t* data, size_t rows,
+                            size_t cols, BinaryModel::Type type, bool transposed) {
+  entries_.push_back({name, type, transposed, rows, cols, cols,
+                      cols * sizeof(uint16_t), reinterpret_cast<const char*>(data)});
+}
+
+void BinaryModelWriter::Write(const std::string& file) const {
+  size_t headerSize = sizeof(MAGIC) + sizeof(uint64_t);
+  for (const Entry& entry : entries_) {
+    headerSize += entry.name.size() + 7 * sizeof(uint64_t);
+  }
+
+  std::vector<size_t> offsets;
+  size_t offset = Align(headerSize);
+  for (const Entry& entry : entries_) {
+    offsets.push_back(offset);
+    offset = Align(offset + entry.rows * entry.spacing * ElementSize(entry.type));
+  }
+
+  std::ofstream out(file, std::ios::binary);
+  amunmt_UTIL_THROW_IF2(!out, "Cannot write " << file);
+  out.write(MAGIC, sizeof(MAGIC));
+  WriteUInt(out, entries_.size());
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const Entry& entry = entries_[i];
+    WriteUInt(out, entry.name.size());
+    out.write(entry.name.data(), entry.name.size());
+    WriteUInt(out, entry.type);
+    WriteUInt(out, entry.transposed);
+    WriteUInt(out, entry.rows);
+    WriteUInt(out, entry.cols);
+    WriteUInt(out, entry.spacing);
+    WriteUInt(out, offsets[i]);
+  }
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const Entry& entry = entries_[i];
+    const size_t rowBytes = entry.cols * ElementSize(entry.type);
+    const std::vector<char> padding(
+        std::max<size_t>(ALIGNMENT, (entry.spacing - entry.cols) * ElementSize(entry.type)), 0);
+    out.write(padding.data(), offsets[i] - static_cast<size_t>(out.tellp()));
+    for (size_t r = 0; r < entry.rows; ++r) {
+      out.write(entry.data + r * entry.stride, rowBytes);
+      out.write(padding.data(), (entry.spacing - entry.cols) * ElementSize(entry.type));
+    }
+  }
+  amunmt_UTIL_THROW_IF2(!out, "Cannot write " << file);
+}
+
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace amunmt {
+namespace CPU {
+
+// Read-only memory mapping of a model in amun's binary format, as written by
+// scripts/npz2bin.py and amun-compile. The file is
+//
+//   header:  char magic[8] = "AMUNBIN1", uint64 count
+//   count x: uint64 nameLength, char name[nameLength],
+//            uint64 type, uint64 transposed, uint64 rows, uint64 cols,
+//            uint64 spacing, uint64 offset
+//   data
+//
+// all little-endian. Each tensor is stored row-major at a 64 byte aligned
+// offset, rows spacing values apart. For float32 spacing is a multiple of 16,
+// so that the tensor can be used in place as an aligned blaze matrix; 16 bit
+// tensors are not padded. A tensor is transposed if it holds the transpose
+// of the .npz array of the same name, which is how vectors are stored, as a
+// single row. Pages are loaded on first use and shared with every other
+// process mapping the same file.
+class BinaryModel {
+  public:
+    enum Type : uint64_t {Float32 = 0, Float16 = 1, BFloat16 = 2};
+
+    struct Tensor {
+      Type type;
+      bool transposed;
+      size_t rows;
+      size_t cols;
+      size_t spacing;
+      const void* data;
+    };
+
+    // Whether file starts with the magic of the format
+    static bool IsBinary(const std::string& file);
+
+    explicit BinaryModel(const std::string& file);
+    ~BinaryModel();
+
+    BinaryModel(const BinaryModel&) = delete;
+    BinaryModel& operator=(const BinaryModel&) = delete;
+
+    // nullptr if there is no tensor called name
+    const Tensor* find(const std::string& name) const;
+
+  private:
+    void* data_;
+    size_t size_;
+    std::map<std::string, Tensor> tensors_;
+};
+
+// Collects tensors and writes them in the format read by BinaryModel. The
+// data passed to Add has to stay valid until Write.
+class BinaryModelWriter {
+  public:
+    // rows x cols floats, stride floats between rows
+    void Add(const std::string& name, const float* data, size_t rows, size_t cols,
+             size_t stride, bool transposed);
+
+    // rows x cols contiguous 16 bit values
+    void Add(const std::string& name, const uint16_t* data, size_t rows, size_t cols,
+             BinaryModel::Type type, bool transposed);
+
+    void Write(const std::string& file) const;
+
+  private:
+    struct Entry {
+      std::string name;
+      BinaryModel::Type type;
+      bool transposed;
+      size_t rows;
+      size_t cols;
+      size_t spacing;
+      size_t stride;
+      const char* data;
+    };
+
+    std::vector<Entry> entries_;
+};
+
+}
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "common/exception.h"
+#include "cpu/binary_model.h"
+#include "cpu/npz_converter.h"
+#include "cpu/dl4mt/model.h"
+#include "cpu/nematus/model.h"
+
+using namespace amunmt;
+using namespace amunmt::CPU;
+
+namespace {
+
+// Marks the tensors the loader would keep in 16 bit, see Weights::ToHalf
+template <class Weights>
+void ToHalf(NpzConverter::Tensors& tensors, const Weights& weights, mblas::HalfType type) {
+  for (auto& it : tensors) {
+    NpzConverter::Tensor& tensor = it.second;
+    const float* data = tensor.matrix.data();
+    if (data == weights.encEmbeddings_.E_.data()
+        || data == weights.decEmbeddings_.E_.data()
+        || data == weights.decSoftmax_.W4_.data()) {
+      tensor.half = mblas::HalfMatrix(tensor.matrix, type);
+    }
+  }
+}
+
+template <class Weights>
+void Compile(NpzConverter& model, NpzConverter::Tensors& tensors, const std::string& precision) {
+  Weights weights(model, 0);
+  if (precision != "fp32") {
+    ToHalf(tensors, weights,
+           precision == "bf16" ? mblas::HalfType::BF16 : mblas::HalfType::FP16);
+  }
+}
+
+}
+
+// Writes a model as the CPU loader uses it: every tensor it reads, plus the
+// fused and zero tensors it would otherwise derive at load time (see
+// NpzConverter::concat), in the binary format of cpu/binary_model.h.
+// Loading the result maps these instead of building them. Still derived at
+// load, when asked for: the int8 copies (--int8), the fused readout
+// (--fused-readout), the embedding tables (--embedding-tables), and the 16-bit
+// copies when a model compiled as fp32 is run with --weight-precision fp16 or
+// bf16.
+int main(int argc, char* argv[])
+{
+  namespace po = boost::program_options;
+  std::string modelPath, type, outputPath, precision;
+
+  po::options_description options("amun-compile options");
+  options.add_options()
+    ("model,m", po::value(&modelPath)->required(),
+     "Model to compile, in .npz or binary format")
+    ("type,t", po::value(&type)->default_value("nematus2"),
+     "Model type, nematus2 or dl4mt")
+    ("output,o", po::value(&outputPath)->required(),
+     "Compiled model to write")
+    ("weight-precision", po::value(&precision)->default_value("fp32"),
+     "Precision of the embeddings and the output layer: fp32, fp16 or bf16")
+    ("help,h", po::value<bool>()->zero_tokens()->default_value(false),
+     "Print this help message and exit")
+    ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+    if (vm["help"].as<bool>()) {
+      std::cout << "Usage: " << argv[0] << " -m model.npz -o model.bin [options]"
+                << std::endl << options << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl << std::endl;
+    std::cerr << options << std::endl;
+    return 1;
+  }
+
+  amunmt_UTIL_THROW_IF2(precision != "fp32" && precision != "fp16" && precision != "bf16",
+                        "Unknown weight precision " << precision);
+
+  NpzConverter::Tensors tensors;
+  {
+    NpzConverter model(modelPath);
+    model.Record(&tensors);
+    if (type == "nematus2") {
+      Compile<Nematus::Weights>(model, tensors, precision);
+    } else {
+      Compile<dl4mt::Weights>(model, tensors, precision);
+    }
+  }
+
+  BinaryModelWriter writer;
+  for (const auto& it : tensors) {
+    const NpzConverter::Tensor& tensor = it.second;
+    if (tensor.half.rows()) {
+      writer.Add(it.first, tensor.half.row(0), tensor.half.rows(), tensor.half.columns(),
+                 tensor.half.type() == mblas::HalfType::BF16 ? BinaryModel::BFloat16
+                                                             : BinaryModel::Float16,
+                 tensor.transposed);
+    } else {
+      writer.Add(it.first, tensor.matrix.data(), tensor.matrix.rows(), tensor.matrix.columns(),
+                 tensor.matrix.spacing(), tensor.transposed);
+    }
+  }
+  writer.Write(outputPath);
+
+  std::cerr << "Wrote " << tensors.size() << " tensors to " << outputPath << std::endl;
+  return 0;
+}
@@ -1,27 +1,17 @@
 #pragma once
 
 #include <vector>
-#include <boost/iterator/permutation_iterator.hpp>
 
 #include "common/scorer.h"
 #include "common/god.h"
 #include "common/exception.h"
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/nth_element.h"
 #include "cpu/decoder/encoder_decoder.h"
 
 namespace amunmt {
 namespace CPU {
 
-struct ProbCompare {
-  ProbCompare(const float* data) : data_(data) {}
-
-  bool operator()(const unsigned a, const unsigned b) {
-    return data_[a] > data_[b];
-  }
-
-  const float* data_;
-};
-
 class BestHyps : public BestHypsBase
 {
   public:
@@ -31,7 +21,8 @@ class BestHyps : public BestHypsBase
           god.Get<bool>("n-best"),
           god.Get<std::vector<std::string>>("softmax-filter").size(),
           god.Get<bool>("return-alignment") || god.Get<bool>("return-soft-alignment") || god.Get<bool>("return-nematus-alignment"),
-          god.GetScorerWeights())
+          god.GetScorerWeights()),
+        nthElement_(god.Get<size_t>("beam-size"))
     {}
 
     void CalcBeam(
@@ -39,83 +30,63 @@ class BestHyps : public BestHypsBase
         const std::vector<ScorerPtr>& scorers,
         const Words& filterIndices,
         std::vector<Beam>& beams,
-        std::vector<uint>& beamSizes)
+        std::vector<uint>& beamSizes,
+        const std::vector<uint>& rowSizes)
     {
       using namespace mblas;
 
       mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
 
-      mblas::ArrayMatrix Costs(Probs.rows(), 1);
+      costs_.resize(Probs.rows());
       for (size_t i = 0; i < prevHyps.size(); ++i) {
-        Costs.data()[i] = prevHyps[i]->GetCost();
-      }
-
-      Probs *= weights_.at(scorers[0]->GetName());
-      AddBiasVector<byColumn>(Probs, Costs);
-
-      for (size_t i = 1; i < scorers.size(); ++i) {
-        mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs());
-
-        Probs += weights_.at(scorers[i]->GetName()) * currProb;
+        costs_[i] = prevHyps[i]->GetCost();
       }
 
-      size_t size = Probs.rows() * Probs.columns(); // Probs.size();
-      std::vector<size_t> keys(size);
-      for (size_t i = 0; i < keys.size(); ++i) {
-        keys[i] = i;
-      }
-
-      size_t beamSize = beamSizes[0];
+      CPUEncoderDecoderBase* fused = SelectBest(scorers, beamSizes, rowSizes);
 
-      std::vector<size_t> bestKeys(beamSize);
-      std::vector<float> bestCosts(beamSize);
-
-      if (forbidUNK_) {
-        blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
+      // sentence of every row of Probs. A sentence whose rows hold fewer than
+      // beamSizes[i] entries (e.g. with a small filtered vocabulary) yields
+      // fewer keys, so each key is placed by its row.
+      rowBatchIds_.clear();
+      for (size_t batchId = 0; batchId < rowSizes.size(); ++batchId) {
+        rowBatchIds_.insert(rowBatchIds_.end(), rowSizes[batchId], batchId);
       }
 
-      std::nth_element(keys.begin(), keys.begin() + beamSize, keys.end(),
-                       ProbCompare(Probs.data()));
-
-      for (size_t i = 0; i < beamSize; ++i) {
-        bestKeys[i] = keys[i];
-        bestCosts[i] = Probs.data()[keys[i]];
+      StepScoresPtr stepScores;
+      if (returnNBestList_) {
+        stepScores = GetStepScores(scorers, fused);
       }
 
-      std::vector<std::vector<float>> breakDowns;
-      if (returnNBestList_) {
-        breakDowns.push_back(bestCosts);
+      // attention of this step, copied once and shared by its hypotheses
+      std::vector<StepAlignmentPtr> stepAlignments;
+      if (returnAttentionWeights_) {
         for (auto& scorer : scorers) {
-          std::vector<float> modelCosts(beamSize);
-          mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorer->GetProbs());
-
-          auto it = boost::make_permutation_iterator(currProb.begin(), keys.begin());
-          std::copy(it, it + beamSize, modelCosts.begin());
-          breakDowns.push_back(modelCosts);
+          if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
+            stepAlignments.push_back(GetStepAlignment(encdec->GetAttention()));
+          } else {
+            amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
+          }
         }
       }
 
-      for (size_t i = 0; i < beamSize; i++) {
-        size_t wordIndex = bestKeys[i] % Probs.columns();
+      for (size_t i = 0; i < bestKeys_.size(); i++) {
+        size_t wordIndex = bestKeys_[i] % Probs.columns();
 
         if (isInputFiltered_) {
           wordIndex = filterIndices[wordIndex];
         }
 
-        size_t hypIndex  = bestKeys[i] / Probs.columns();
-        float cost = bestCosts[i];
+        size_t hypIndex  = bestKeys_[i] / Probs.columns();
+        size_t batchId = rowBatchIds_[hypIndex];
+        float cost = bestCosts_[i];
 
         HypothesisPtr hyp;
         if (returnAttentionWeights_) {
-          std::vector<SoftAlignmentPtr> alignments;
-          for (auto& scorer : scorers) {
-            if (CPU::CPUEncoderDecoderBase* encdec = dynamic_cast<CPU::CPUEncoderDecoderBase*>(scorer.get())) {
-              auto& attention = encdec->GetAttention();
-              alignments.emplace_back(new SoftAlignment(attention.begin(hypIndex),
-                                                        attention.end(hypIndex)));
-            } else {
-              amunmt_UTIL_THROW2("Return Alignment is allowed only with Nematus scorer.");
-            }
+          std::vector<AlignmentRef> alignments;
+          for (size_t j = 0; j < scorers.size(); ++j) {
+            auto encdec = static_cast<CPU::CPUEncoderDecoderBase*>(scorers[j].get());
+            size_t sourceLength = encdec->GetSourceLengths()[batchId];
+            alignments.push_back({ stepAlignments[j], hypIndex, sourceLength });
           }
 
           hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost, alignments));
@@ -123,29 +94,143 @@ class BestHyps : public BestHypsBase
           hyp.reset(new Hypothesis(prevHyps[hypIndex], wordIndex, hypIndex, cost));
         }
 
-        if (returnNBestList_) {
-          hyp->GetCostBreakdown().resize(scorers.size());
-          float sum = 0;
-          for(size_t j = 0; j < scorers.size(); ++j) {
-            if (j == 0) {
-              hyp->GetCostBreakdown()[0] = breakDowns[0][i];
-            } else {
-              float cost = 0;
-              if (j < scorers.size()) {
-                if (prevHyps[hypIndex]->GetCostBreakdown().size() < scorers.size())
-                  const_cast<HypothesisPtr&>(prevHyps[hypIndex])->GetCostBreakdown().resize(scorers.size(), 0.0);
-                cost = breakDowns[j][i] + const_cast<HypothesisPtr&>(prevHyps[hypIndex])->GetCostBreakdown()[j];
-              }
-              sum += weights_.at(scorers[j]->GetName()) * cost;
-              hyp->GetCostBreakdown()[j] = cost;
-            }
-          }
-          hyp->GetCostBreakdown()[0] -= sum;
-          hyp->GetCostBreakdown()[0] /= weights_.at(scorers[0]->GetName());
+        if (stepScores) {
+          hyp->SetStepScores(stepScores, i);
         }
-        beams[0].push_back(hyp);
+        beams[batchId].push_back(hyp);
+      }
+    }
+
+    void CalcArgmax(
+        const std::vector<ScorerPtr>& scorers,
+        const Words& filterIndices,
+        Words& words,
+        std::vector<float>& costs)
+    {
+      mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
+
+      costs_.assign(Probs.rows(), 0.0f);
+      rowSizes_.assign(Probs.rows(), 1);
+      SelectBest(scorers, rowSizes_, rowSizes_);
+
+      words.resize(bestKeys_.size());
+      costs.resize(bestKeys_.size());
+      for (size_t i = 0; i < bestKeys_.size(); ++i) {
+        words[i] = bestKeys_[i] % Probs.columns();
+        if (isInputFiltered_) {
+          words[i] = filterIndices[words[i]];
+        }
+        costs[i] = bestCosts_[i];
+      }
+    }
+
+  private:
+    StepAlignmentPtr GetStepAlignment(const mblas::Matrix& attention) const {
+      std::shared_ptr<StepAlignment> step(new StepAlignment());
+      step->columns = attention.columns();
+      step->weights.resize(attention.rows() * attention.columns());
+      for (size_t i = 0; i < attention.rows(); ++i) {
+        std::copy(attention.begin(i), attention.end(i), step->weights.begin() + i * step->columns);
       }
+      return step;
     }
+
+    // Unweighted score of each scorer for every selected entry. Unless fused,
+    // Probs of the first scorer was overwritten by SelectBest, so its score is
+    // recovered from the total.
+    StepScoresPtr GetStepScores(const std::vector<ScorerPtr>& scorers,
+                                CPUEncoderDecoderBase* fused) const {
+      const mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
+      const size_t cols = Probs.columns();
+
+      std::shared_ptr<StepScores> step(new StepScores());
+      step->numScorers = scorers.size();
+      step->scores.resize(bestKeys_.size() * scorers.size());
+
+      for (size_t i = 0; i < bestKeys_.size(); ++i) {
+        float* scores = step->scores.data() + i * scorers.size();
+        size_t row = bestKeys_[i] / cols;
+
+        if (fused) {
+          scores[0] = Probs.data()[bestKeys_[i]] - fused->GetLogNorms()[row];
+          continue;
+        }
+
+        float rest = bestCosts_[i] - costs_[row];
+        for (size_t j = 1; j < scorers.size(); ++j) {
+          const mblas::ArrayMatrix& currProb = static_cast<mblas::ArrayMatrix&>(scorers[j]->GetProbs());
+          scores[j] = currProb.data()[bestKeys_[i]];
+          rest -= weights_.at(scorers[j]->GetName()) * scores[j];
+        }
+        scores[0] = rest / weights_.at(scorers[0]->GetName());
+      }
+      return step;
+    }
+
+    // Scores every entry as the weighted sum of the scorers' log-probabilities
+    // plus costs_[row] and leaves the best beamSizes[i] entries of the rowSizes[i]
+    // rows of each sentence i in bestCosts_/bestKeys_. A lone CPU scorer leaves
+    // logits in Probs (see GetLogNorms): these are ranked directly and only the
+    // chosen entries are normalised, instead of rewriting Probs. That scorer is
+    // returned then.
+    CPUEncoderDecoderBase* SelectBest(
+        const std::vector<ScorerPtr>& scorers,
+        const std::vector<uint>& beamSizes,
+        const std::vector<uint>& rowSizes)
+    {
+      using namespace mblas;
+
+      mblas::ArrayMatrix& Probs = static_cast<mblas::ArrayMatrix&>(scorers[0]->GetProbs());
+
+      bestKeys_.clear();
+      bestCosts_.clear();
+
+      CPUEncoderDecoderBase* fused = nullptr;
+      if (scorers.size() == 1) {
+        fused = dynamic_cast<CPUEncoderDecoderBase*>(scorers[0].get());
+        if (fused && fused->GetLogNorms().empty()) {
+          fused = nullptr;
+        }
+      }
+
+      if (fused) {
+        if (forbidUNK_) {
+          blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
+        }
+
+        nthElement_.getNBestList(beamSizes, rowSizes, Probs, fused->GetLogNorms(),
+                                 weights_.at(scorers[0]->GetName()), costs_,
+                                 bestCosts_, bestKeys_);
+      } else {
+        mblas::ArrayMatrix Costs(Probs.rows(), 1);
+        std::copy(costs_.begin(), costs_.end(), Costs.data());
+
+        Probs *= weights_.at(scorers[0]->GetName());
+        AddBiasVector<byColumn>(Probs, Costs);
+
+        for (size_t i = 1; i < scorers.size(); ++i) {
+          mblas::ArrayMatrix &currProb = static_cast<mblas::ArrayMatrix&>(scorers[i]->GetProbs());
+
+          Probs += weights_.at(scorers[i]->GetName()) * currProb;
+        }
+
+        if (forbidUNK_) {
+          blaze::column(Probs, UNK_ID) = std::numeric_limits<float>::lowest();
+        }
+
+        nthElement_.getNBestList(beamSizes, rowSizes, Probs, bestCosts_, bestKeys_);
+      }
+      return fused;
+    }
+
+    mblas::NthElement nthElement_;
+
+    // reused between steps to avoid reallocating
+    std::vector<size_t> bestKeys_;
+    std::vector<float> bestCosts_;
+    std::vector<size_t> rowBatchIds_;
+    std::vector<float> costs_;
+    std::vector<uint> rowSizes_;
 };
 
 }  // namespace CPU
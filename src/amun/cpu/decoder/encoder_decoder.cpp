@@ -1,9 +1,11 @@
 #include "cpu/decoder/encoder_decoder.h"
 
 #include <vector>
+#include <algorithm>
 #include <yaml-cpp/yaml.h>
 
 #include "common/scorer.h"
+#include "common/logging.h"
 
 namespace amunmt {
 namespace CPU {
@@ -16,11 +18,68 @@ CPUEncoderDecoderBase::CPUEncoderDecoderBase(
     const std::string& name,
     const YAML::Node& config,
     size_t tab)
-  : Scorer(god, name, config, tab)
+  : Scorer(god, name, config, tab),
+    maxLength_(0),
+    allocations_(mblas::Allocations()),
+    warmedUp_(false),
+    usedStates_(0)
 {}
 
 State* CPUEncoderDecoderBase::NewState() const {
-  return new EDState();
+  if (usedStates_ == stateStorage_.size()) {
+    stateStorage_.emplace_back(new EDState::Storage());
+  }
+  return new EDState(*stateStorage_[usedStates_++]);
+}
+
+void CPUEncoderDecoderBase::CleanUpAfterSentence() {
+  size_t allocations = mblas::Allocations();
+  if (warmedUp_ && allocations != allocations_) {
+    LOG(info)->debug("{}: {} matrix reallocations on this thread after warm-up",
+                     name_, allocations - allocations_);
+  }
+  allocations_ = allocations;
+  warmedUp_ = true;
+}
+
+void CPUEncoderDecoderBase::InitBatch() {
+  usedStates_ = 0;
+  activeIds_.resize(sourceLengths_.size());
+  for (size_t i = 0; i < activeIds_.size(); ++i) {
+    activeIds_[i] = i;
+  }
+  activeLengths_ = sourceLengths_;
+  maxLength_ = SourceContext_.rows() / sourceLengths_.size();
+}
+
+const std::vector<uint>& CPUEncoderDecoderBase::CompactBatch(const std::vector<uint>& beamSizes) {
+  keep_.clear();
+  size_t newMaxLength = 0;
+  for (size_t i = 0; i < activeIds_.size(); ++i) {
+    if (beamSizes[activeIds_[i]] > 0) {
+      keep_.push_back(i);
+      newMaxLength = std::max(newMaxLength, activeLengths_[i]);
+    }
+  }
+
+  if (keep_.size() < activeIds_.size()) {
+    mblas::CompactRowBlocks(SourceContext_, keep_, maxLength_, newMaxLength);
+    CompactSource(keep_, maxLength_, newMaxLength);
+
+    for (size_t i = 0; i < keep_.size(); ++i) {
+      activeIds_[i] = activeIds_[keep_[i]];
+      activeLengths_[i] = activeLengths_[keep_[i]];
+    }
+    activeIds_.resize(keep_.size());
+    activeLengths_.resize(keep_.size());
+    maxLength_ = newMaxLength;
+  }
+
+  activeBeamSizes_.resize(activeIds_.size());
+  for (size_t i = 0; i < activeIds_.size(); ++i) {
+    activeBeamSizes_[i] = beamSizes[activeIds_[i]];
+  }
+  return activeBeamSizes_;
 }
 
 
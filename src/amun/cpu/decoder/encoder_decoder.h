@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <yaml-cpp/yaml.h>
 
 #include "common/scorer.h"
@@ -20,13 +21,60 @@ class CPUEncoderDecoderBase : public Scorer {
         const YAML::Node& config,
         size_t tab);
 
+    // The states of a batch live in storage of this scorer that the next
+    // batch reuses: they are valid until the next Encode.
     virtual State* NewState() const;
 
+    // Logs at debug level how often this thread's mblas matrices had to grow
+    // since the last call (see mblas::Allocations), if they did after the
+    // first batch, which sizes them.
+    virtual void CleanUpAfterSentence();
+
     virtual void GetAttention(mblas::Matrix& Attention) = 0;
     virtual mblas::Matrix& GetAttention() = 0;
 
+    // Per-row log-partition of GetProbs() if it holds unnormalised logits,
+    // empty if it already holds log-probabilities.
+    virtual const std::vector<float>& GetLogNorms() const = 0;
+
+    const std::vector<size_t>& GetSourceLengths() const {
+      return sourceLengths_;
+    }
+
   protected:
+    // To be called once the batch is encoded: all of its sentences are active.
+    // Also hands the state storage of the previous batch out again.
+    void InitBatch();
+
+    // Drops the source blocks of sentences that finished since the last step
+    // (beamSizes[i] == 0, indexed by the whole batch) and shrinks the blocks to
+    // the longest remaining sentence. Returns beamSizes of the active sentences.
+    const std::vector<uint>& CompactBatch(const std::vector<uint>& beamSizes);
+
+    // Compacts the decoder's own per-source-position data the same way.
+    virtual void CompactSource(const std::vector<size_t>& keep,
+                               size_t maxLength, size_t newMaxLength) = 0;
+
+    // encoded source sentences of the active part of the batch, one padded
+    // block of maxLength_ rows per sentence
     mblas::Matrix SourceContext_;
+    // lengths of all sentences of the batch
+    std::vector<size_t> sourceLengths_;
+
+    // batch positions and lengths of the sentences still in SourceContext_
+    std::vector<size_t> activeIds_;
+    std::vector<size_t> activeLengths_;
+    std::vector<uint> activeBeamSizes_;
+    std::vector<size_t> keep_;
+    size_t maxLength_;
+
+    size_t allocations_;
+    bool warmedUp_;
+
+    // storage of the states of the current batch, the first usedStates_ of
+    // it handed out by NewState
+    mutable std::vector<std::unique_ptr<EncoderDecoderState::Storage>> stateStorage_;
+    mutable size_t usedStates_;
 };
 
 
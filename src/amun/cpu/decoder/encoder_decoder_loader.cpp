@@ -19,7 +19,7 @@ EncoderDecoderLoader::EncoderDecoderLoader(
   : Loader(name, config)
 {}
 
-void EncoderDecoderLoader::Load(const God&) {
+void EncoderDecoderLoader::Load(const God& god) {
   std::string path = Get<std::string>("path");
   std::string type = Get<std::string>("type");
 
@@ -27,8 +27,58 @@ void EncoderDecoderLoader::Load(const God&) {
   LOG(info)->info("Model type: {}", type);
   if (type == "nematus2") {
     nematusModels_.emplace_back(new Nematus::Weights(path, 0));
+    ToHalf(god, *nematusModels_.back());
+    FuseReadout(god, *nematusModels_.back());
+    ToInt8(god, *nematusModels_.back());
+    PrecomputeTables(god, *nematusModels_.back());
   } else {
     dl4mtModels_.emplace_back(new dl4mt::Weights(path, 0));
+    ToHalf(god, *dl4mtModels_.back());
+    FuseReadout(god, *dl4mtModels_.back());
+    ToInt8(god, *dl4mtModels_.back());
+    PrecomputeTables(god, *dl4mtModels_.back());
+  }
+}
+
+// last, so that the tables come from the same 16 bit embeddings and int8
+// weights as the rows the decoder computes per step
+template <class Weights>
+void EncoderDecoderLoader::PrecomputeTables(const God& god, Weights& weights) {
+  size_t budget = god.Get<size_t>("embedding-tables");
+  if (budget == 0) {
+    return;
+  }
+  // with a fused readout the embedding enters the stacked readout GEMM as is
+  weights.PrecomputeTables(god.Get<size_t>("embedding-table-words"), budget * 1024 * 1024,
+                           !god.Get<bool>("fused-readout"));
+  LOG(info)->info("Precomputed embedding tables for {} target words ({} readout rows)",
+                  weights.decTables_.GRU_.rows(), weights.decTables_.Readout_.rows());
+}
+
+template <class Weights>
+void EncoderDecoderLoader::ToHalf(const God& god, Weights& weights) {
+  std::string precision = god.Get<std::string>("weight-precision");
+  if (precision == "fp32") {
+    return;
+  }
+  weights.ToHalf(precision == "bf16" ? mblas::HalfType::BF16 : mblas::HalfType::FP16);
+  LOG(info)->info("Embeddings and output layer stored in {}", precision);
+}
+
+template <class Weights>
+void EncoderDecoderLoader::FuseReadout(const God& god, Weights& weights) {
+  if (god.Get<bool>("fused-readout")) {
+    weights.FuseReadout();
+  }
+}
+
+// after ToHalf, so that a 16 bit output layer is quantised from what the
+// decoder would otherwise multiply by
+template <class Weights>
+void EncoderDecoderLoader::ToInt8(const God& god, Weights& weights) {
+  if (god.Get<bool>("int8")) {
+    weights.ToInt8();
+    LOG(info)->info("Decoder GEMMs in int8");
   }
 }
 
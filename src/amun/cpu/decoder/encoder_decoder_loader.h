@@ -31,6 +31,18 @@ class EncoderDecoderLoader : public Loader {
     BestHypsBasePtr GetBestHyps(const God &god, const DeviceInfo &deviceInfo) const;
 
   private:
+    template <class Weights>
+    void PrecomputeTables(const God& god, Weights& weights);
+
+    template <class Weights>
+    void ToHalf(const God& god, Weights& weights);
+
+    template <class Weights>
+    void FuseReadout(const God& god, Weights& weights);
+
+    template <class Weights>
+    void ToInt8(const God& god, Weights& weights);
+
     std::vector<std::unique_ptr<dl4mt::Weights>> dl4mtModels_;
     std::vector<std::unique_ptr<Nematus::Weights>> nematusModels_;
 };
@@ -5,29 +5,38 @@ namespace CPU {
 
 using EDState = EncoderDecoderState;
 
-EncoderDecoderState::EncoderDecoderState()
+EncoderDecoderState::EncoderDecoderState(Storage& storage)
+  : storage_(storage)
 {
 }
 
 std::string EncoderDecoderState::Debug(size_t verbosity) const
 {
-	return CPU::mblas::Debug(states_);
+	return CPU::mblas::Debug(storage_.states);
 }
 
 CPU::mblas::Matrix& EncoderDecoderState::GetStates() {
-  return states_;
+  return storage_.states;
 }
 
 CPU::mblas::Matrix& EncoderDecoderState::GetEmbeddings() {
-  return embeddings_;
+  return storage_.embeddings;
 }
 
 const CPU::mblas::Matrix& EncoderDecoderState::GetStates() const {
-  return states_;
+  return storage_.states;
 }
 
 const CPU::mblas::Matrix& EncoderDecoderState::GetEmbeddings() const {
-  return embeddings_;
+  return storage_.embeddings;
+}
+
+std::vector<size_t>& EncoderDecoderState::GetWords() {
+  return storage_.words;
+}
+
+const std::vector<size_t>& EncoderDecoderState::GetWords() const {
+  return storage_.words;
 }
 
 }
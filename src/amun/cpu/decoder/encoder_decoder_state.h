@@ -10,7 +10,15 @@ namespace CPU {
 
 class EncoderDecoderState : public State {
   public:
-    EncoderDecoderState();
+    // Contents of a state. The scorer owns it, so that its matrices keep their
+    // capacity from one batch to the next (see CPUEncoderDecoderBase::NewState).
+    struct Storage {
+      CPU::mblas::Matrix states;
+      CPU::mblas::Matrix embeddings;
+      std::vector<size_t> words;
+    };
+
+    explicit EncoderDecoderState(Storage& storage);
     EncoderDecoderState(const EncoderDecoderState&) = delete;
 
     virtual std::string Debug(size_t verbosity = 1) const;
@@ -21,9 +29,12 @@ class EncoderDecoderState : public State {
   	CPU::mblas::Matrix& GetEmbeddings();
     const CPU::mblas::Matrix& GetEmbeddings() const;
 
+    // word of each row of GetEmbeddings(), empty for the initial zero embeddings
+    std::vector<size_t>& GetWords();
+    const std::vector<size_t>& GetWords() const;
+
   private:
-    CPU::mblas::Matrix states_;
-    CPU::mblas::Matrix embeddings_;
+    Storage& storage_;
 };
 
 }  // namespace CPU
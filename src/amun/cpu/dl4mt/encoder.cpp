@@ -1,31 +1,46 @@
 #include "encoder.h"
 
+#include "common/sentences.h"
+
 using namespace std;
 
 namespace amunmt {
 namespace CPU {
 namespace dl4mt {
 
-void Encoder::Encode(const std::vector<size_t>& words,
-				mblas::Matrix& context) {
-  std::vector<mblas::Matrix> embeddedWords;
+void Encoder::Encode(const Sentences& source, size_t tab,
+				mblas::Matrix& context, std::vector<size_t>& sourceLengths) {
+  size_t maxLength = 0;
+  sourceLengths.resize(source.size());
+  for (size_t i = 0; i < source.size(); ++i) {
+    sourceLengths[i] = source.at(i)->GetWords(tab).size();
+    maxLength = std::max(maxLength, sourceLengths[i]);
+  }
 
-  context.resize(words.size(),
+  context.resize(source.size() * maxLength,
 				 forwardRnn_.GetStateLength()
 				 + backwardRnn_.GetStateLength());
-  for(auto& w : words) {
-    embeddedWords.emplace_back();
-    mblas::Matrix &embed = embeddedWords.back();
-    embeddings_.Lookup(embed, w);
-    //cerr << "embed=" << embed.Debug(true) << endl;
+
+  // one batchSize x dim matrix per position, shorter sentences are padded with EOS.
+  // The matrices are kept for the next batch.
+  if (embeddedWords_.size() < maxLength) {
+    embeddedWords_.resize(maxLength);
+  }
+  words_.resize(source.size());
+  for(size_t pos = 0; pos < maxLength; ++pos) {
+    for(size_t i = 0; i < source.size(); ++i) {
+      const Words& sentence = source.at(i)->GetWords(tab);
+      words_[i] = (pos < sentence.size()) ? sentence[pos] : EOS_ID;
+    }
+    embeddings_.Lookup(embeddedWords_[pos], words_);
   }
 
-  forwardRnn_.Encode(embeddedWords.cbegin(),
-						 embeddedWords.cend(),
-						 context, false);
-  backwardRnn_.Encode(embeddedWords.crbegin(),
-						  embeddedWords.crend(),
-						  context, true);
+  auto end = embeddedWords_.cbegin() + maxLength;
+  forwardRnn_.Encode(embeddedWords_.cbegin(), end,
+						 context, sourceLengths, false);
+  backwardRnn_.Encode(std::reverse_iterator<decltype(end)>(end),
+						  embeddedWords_.crend(),
+						  context, sourceLengths, true);
 }
 
 }
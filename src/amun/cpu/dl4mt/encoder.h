@@ -5,6 +5,9 @@
 #include "../dl4mt/gru.h"
 
 namespace amunmt {
+
+class Sentences;
+
 namespace CPU {
 namespace dl4mt {
 
@@ -19,16 +22,18 @@ class Encoder {
         : w_(model)
         {}
           
-        void Lookup(mblas::Matrix& Row, size_t i) {
-		  size_t len = w_.E_.columns();
-          if(i < w_.E_.rows())
-            Row = blaze::submatrix(w_.E_, i, 0, 1, len);
-          else
-            Row = blaze::submatrix(w_.E_, 1, 0, 1, len); // UNK
+        void Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) {
+          using namespace mblas;
+          ids_ = ids;
+          for(auto&& id : ids_)
+            if(id >= w_.rows())
+              id = 1; // UNK
+          w_.Lookup(Rows, ids_);
         }
       
         const Weights& w_;
       private:
+        std::vector<size_t> ids_;
     };
     
     /////////////////////////////////////////////////////////////////
@@ -50,20 +55,26 @@ class Encoder {
         }
         
         template <class It>
-        void Encode(It it, It end,
-                        mblas::Matrix& Context, bool invert) {
-          InitializeState();
+        void Encode(It it, It end, mblas::Matrix& Context,
+                    const std::vector<size_t>& sourceLengths, bool invert) {
+          size_t batchSize = sourceLengths.size();
+          InitializeState(batchSize);
           
           size_t n = std::distance(it, end);
+          size_t len = gru_.GetStateLength();
           size_t i = 0;
           while(it != end) {
             GetNextState(State_, State_, *it++);
             
-			size_t len = gru_.GetStateLength();
-            if(invert)
-              blaze::submatrix(Context, n - i - 1, len, 1, len) = State_;
-            else
-			  blaze::submatrix(Context, i, 0, 1, len) = State_;
+            size_t pos = invert ? n - i - 1 : i;
+            for(size_t j = 0; j < batchSize; ++j) {
+              if(invert && pos >= sourceLengths[j]) {
+                // padding, the backward pass has to start at the last real word
+                blaze::row(State_, j) = 0.0f;
+              }
+              blaze::submatrix(Context, j * n + pos, invert ? len : 0, 1, len)
+                = blaze::submatrix(State_, j, 0, 1, len);
+            }
             ++i;
           }
         }
@@ -87,13 +98,16 @@ class Encoder {
       backwardRnn_(model.encBackwardGRU_)
     {}
     
-    void Encode(const std::vector<size_t>& words,
-                    mblas::Matrix& context);
+    void Encode(const Sentences& source, size_t tab, mblas::Matrix& context,
+                std::vector<size_t>& sourceLengths);
     
   private:
     Embeddings<Weights::Embeddings> embeddings_;
     RNN<Weights::GRU> forwardRnn_;
     RNN<Weights::GRU> backwardRnn_;
+
+    std::vector<mblas::Matrix> embeddedWords_;
+    std::vector<size_t> words_;
 };
 
 }
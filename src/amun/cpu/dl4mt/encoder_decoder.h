@@ -43,16 +43,25 @@ class EncoderDecoder : public CPUEncoderDecoderBase {
                                    const Beam& beam,
                                    State& out);
 
+    virtual void AssembleGreedyState(State& in,
+                                     const std::vector<size_t>& rows,
+                                     const Words& words,
+                                     State& out);
+
     void GetAttention(mblas::Matrix& Attention);
     mblas::Matrix& GetAttention();
 
     size_t GetVocabSize() const;
 
     BaseMatrix& GetProbs();
+    const std::vector<float>& GetLogNorms() const;
 
     void Filter(const std::vector<size_t>& filterIds);
 
   protected:
+    virtual void CompactSource(const std::vector<size_t>& keep,
+                               size_t maxLength, size_t newMaxLength);
+
     const Weights& model_;
     std::unique_ptr<Encoder> encoder_;
     std::unique_ptr<Decoder> decoder_;
@@ -1,5 +1,7 @@
 #pragma once
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/gates.h"
+#include "cpu/mblas/int8.h"
 
 namespace amunmt {
 namespace CPU {
@@ -8,66 +10,67 @@ namespace dl4mt {
 template <class Weights>
 class GRU {
   public:
+    // Multiplies by the int8 copies of WWx_ and UUx_ once the loader has
+    // made them, see Weights::ToInt8.
     GRU(const Weights& model)
-    : w_(model) {
-      using namespace mblas;
-      WWx_ = Concat<byColumn, Matrix>(w_.W_, w_.Wx_);
-      UUx_ = Concat<byColumn, Matrix>(w_.U_, w_.Ux_);
-    }
+    : w_(model), int8_(w_.WWx8_.rows()) {}
 
     void GetNextState(mblas::Matrix& NextState,
                       const mblas::Matrix& State,
                       const mblas::Matrix& Context) const {
-      RUH_ = Context * WWx_;
+      GetInputProjection(RUH_, Context);
+      GetNextState(NextState, State, RUH_, 0);
+    }
+
+    // Input side of the update for every row of Context
+    void GetInputProjection(mblas::Matrix& RUH, const mblas::Matrix& Context) const {
+      if (int8_) {
+        mblas::Multiply(RUH, Context, w_.WWx8_);
+      } else {
+        mblas::Multiply(RUH, Context, w_.WWx_);
+      }
       if (w_.Gamma_1_.rows()) {
-        LayerNormalization(RUH_, w_.Gamma_1_);
+        LayerNormalization(RUH, w_.Gamma_1_, w_.BBx1_, 1e-9f);
+      } else {
+        mblas::AddBiasVector<mblas::byRow>(RUH, w_.BBx1_);
       }
+    }
 
-      Temp_ = State * UUx_;
+    // Same update with the input projection taken from rows
+    // [firstRow, firstRow + State.rows()) of RUH, see GetInputProjection.
+    void GetNextState(mblas::Matrix& NextState,
+                      const mblas::Matrix& State,
+                      const mblas::Matrix& RUH,
+                      size_t firstRow) const {
+      if (int8_) {
+        mblas::Multiply(Temp_, State, w_.UUx8_);
+      } else {
+        mblas::Multiply(Temp_, State, w_.UUx_);
+      }
       if (w_.Gamma_2_.rows()) {
-        LayerNormalization(Temp_, w_.Gamma_2_);
+        LayerNormalization(Temp_, w_.Gamma_2_, w_.ZBx2_, 1e-9f);
+      } else {
+        mblas::AddBiasVector<mblas::byRow>(Temp_, w_.ZBx2_);
       }
 
-      // @TODO: once broadcasting is available
-      // implement this using blaze idioms
-      ElementwiseOps(NextState, State);
+      ElementwiseOps(NextState, State, RUH, firstRow);
     }
 
     void ElementwiseOps(mblas::Matrix& NextState,
-                        const mblas::Matrix& State) const {
-
-      using namespace mblas;
-      using namespace blaze;
-
+                        const mblas::Matrix& State,
+                        const mblas::Matrix& RUH,
+                        size_t firstRow) const {
       const size_t rowNo = State.rows();
       const size_t colNo = State.columns();
-      NextState.resize(rowNo, colNo);
-
-      for(int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for(int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + w_.B_(0, i) + rowT[i]));
-          float r = 1.0 / (1.0 + ev1);
-
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + w_.B_(0, k) + rowT[k]));
-          float u = 1.0 / (1.0 + ev2);
-
-          float hv = rowH[i] + w_.Bx1_(0, i);
-          float t2v = rowT2[i] + w_.Bx2_(0, i);
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0 - u) * hv + u * rowState[i];
-        }
+      mblas::Reserve(NextState, rowNo, colNo);
+
+      for (size_t j = 0; j < rowNo; ++j) {
+        const float* ruh = RUH.data(firstRow + j);
+        const float* t = Temp_.data(j);
+        mblas::GRUGates(NextState.data(j), State.data(j),
+                        ruh, ruh + colNo, ruh + 2 * colNo,
+                        t, t + colNo, t + 2 * colNo, colNo);
       }
-
     }
 
     size_t GetStateLength() const {
@@ -78,8 +81,7 @@ class GRU {
   private:
     // Model matrices
     const Weights& w_;
-    mutable mblas::Matrix WWx_;
-    mutable mblas::Matrix UUx_;
+    bool int8_;
 
     // reused to avoid allocation
     mutable mblas::Matrix RUH_;
@@ -1,5 +1,10 @@
 #include "model.h"
 
+#include <algorithm>
+#include <numeric>
+
+#include "gru.h"
+
 using namespace std;
 
 namespace amunmt {
@@ -7,25 +12,63 @@ namespace CPU {
 namespace dl4mt {
 
 Weights::Embeddings::Embeddings(const NpzConverter& model, const std::string &key)
-  : E_(model[key])
+  : E_(model[key]),
+    EHalf_(model.getHalf({std::make_pair(key, false)}))
 {}
 
 Weights::Embeddings::Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys)
-  : E_(model.getFirstOfMany(keys))
+  : E_(model.getFirstOfMany(keys)),
+    EHalf_(model.getHalf(keys))
 {}
 
+void Weights::Embeddings::Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) const {
+  if (EHalf_.rows()) {
+    mblas::AssembleRows(Rows, EHalf_, ids);
+  } else {
+    mblas::Assemble<mblas::byRow>(Rows, E_, ids);
+  }
+}
+
+size_t Weights::Embeddings::rows() const {
+  return EHalf_.rows() ? EHalf_.rows() : E_.rows();
+}
+
+size_t Weights::Embeddings::columns() const {
+  return EHalf_.rows() ? EHalf_.columns() : E_.columns();
+}
+
+void Weights::Embeddings::ToHalf(mblas::HalfType type) {
+  if (E_.rows()) {
+    EHalf_ = mblas::HalfMatrix(E_, type);
+    E_ = mblas::WeightMatrix();
+  }
+}
+
 Weights::GRU::GRU(const NpzConverter& model, const std::vector<std::string> &keys)
   : W_(model[keys.at(0)]),
     B_(model(keys.at(1), true)),
     U_(model[keys.at(2)]),
     Wx_(model[keys.at(3)]),
     Bx1_(model(keys.at(4), true)),
-    Bx2_(Bx1_.rows(), Bx1_.columns()),
+    Bx2_(model.zeros(Bx1_.rows(), Bx1_.columns())),
     Ux_(model[keys.at(5)]),
-    Gamma_1_(model[keys.at(6)]),
-    Gamma_2_(model[keys.at(7)])
-{
-    const_cast<mblas::Matrix&>(Bx2_) = 0.0f;
+    Gamma_1_(model(keys.at(6), true)),
+    Gamma_2_(model(keys.at(7), true)),
+    WWx_(model.concat(keys.at(0), W_, keys.at(3), Wx_)),
+    UUx_(model.concat(keys.at(2), U_, keys.at(5), Ux_)),
+    BBx1_(model.concat(keys.at(1), B_, keys.at(4), Bx1_)),
+    ZBx2_(model.concat(NpzConverter::zerosKey(1, 2 * Bx2_.columns()),
+                       model.zeros(1, 2 * Bx2_.columns()),
+                       NpzConverter::zerosKey(Bx2_.rows(), Bx2_.columns()), Bx2_))
+{}
+
+void Weights::GRU::ToInt8() {
+  if (WWx_.rows()) {
+    WWx8_ = mblas::Int8Matrix(WWx_);
+    UUx8_ = mblas::Int8Matrix(UUx_);
+    WWx_ = mblas::WeightMatrix();
+    UUx_ = mblas::WeightMatrix();
+  }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -33,7 +76,7 @@ Weights::GRU::GRU(const NpzConverter& model, const std::vector<std::string> &key
 Weights::DecInit::DecInit(const NpzConverter& model)
   : Wi_(model["ff_state_W"]),
     Bi_(model("ff_state_b", true)),
-    Gamma_(model["ff_state_gamma"])
+    Gamma_(model("ff_state_gamma", true))
 {}
 
 Weights::DecGRU2::DecGRU2(const NpzConverter& model)
@@ -42,12 +85,25 @@ Weights::DecGRU2::DecGRU2(const NpzConverter& model)
   U_(model["decoder_U_nl"]),
   Wx_(model["decoder_Wcx"]),
   Bx2_(model("decoder_bx_nl", true)),
-  Bx1_(Bx2_.rows(), Bx2_.columns()),
+  Bx1_(model.zeros(Bx2_.rows(), Bx2_.columns())),
   Ux_(model["decoder_Ux_nl"]),
-  Gamma_1_(model["decoder_cell2_gamma1"]),
-  Gamma_2_(model["decoder_cell2_gamma2"])
-{
-    const_cast<mblas::Matrix&>(Bx1_) = 0.0f;
+  Gamma_1_(model("decoder_cell2_gamma1", true)),
+  Gamma_2_(model("decoder_cell2_gamma2", true)),
+  WWx_(model.concat("decoder_Wc", W_, "decoder_Wcx", Wx_)),
+  UUx_(model.concat("decoder_U_nl", U_, "decoder_Ux_nl", Ux_)),
+  BBx1_(model.concat("decoder_b_nl", B_, NpzConverter::zerosKey(Bx2_.rows(), Bx2_.columns()), Bx1_)),
+  ZBx2_(model.concat(NpzConverter::zerosKey(1, 2 * Bx2_.columns()),
+                     model.zeros(1, 2 * Bx2_.columns()),
+                     "decoder_bx_nl", Bx2_))
+{}
+
+void Weights::DecGRU2::ToInt8() {
+  if (WWx_.rows()) {
+    WWx8_ = mblas::Int8Matrix(WWx_);
+    UUx8_ = mblas::Int8Matrix(UUx_);
+    WWx_ = mblas::WeightMatrix();
+    UUx_ = mblas::WeightMatrix();
+  }
 }
 
 Weights::DecAttention::DecAttention(const NpzConverter& model)
@@ -56,8 +112,8 @@ Weights::DecAttention::DecAttention(const NpzConverter& model)
   B_(model("decoder_b_att", true)),
   U_(model["decoder_Wc_att"]),
   C_(model["decoder_c_tt"]), // scalar?
-  Gamma_1_(model["decoder_att_gamma1"]),
-  Gamma_2_(model["decoder_att_gamma2"])
+  Gamma_1_(model("decoder_att_gamma1", true)),
+  Gamma_2_(model("decoder_att_gamma2", true))
 {}
 
 Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
@@ -69,12 +125,41 @@ Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
   B3_(model("ff_logit_ctx_b", true)),
   W4_(model.getFirstOfMany({std::pair<std::string, bool>(std::string("ff_logit_W"), false),
              std::make_pair(std::string("Wemb_dec"), true)})),
+  W4Half_(model.getHalf({std::make_pair(std::string("ff_logit_W"), false)})),
   B4_(model("ff_logit_b", true)),
-  Gamma_0_(model["ff_logit_l1_gamma0"]),
-  Gamma_1_(model["ff_logit_l1_gamma1"]),
-  Gamma_2_(model["ff_logit_l1_gamma2"])
+  Gamma_0_(model("ff_logit_l1_gamma0", true)),
+  Gamma_1_(model("ff_logit_l1_gamma1", true)),
+  Gamma_2_(model("ff_logit_l1_gamma2", true))
 {}
 
+void Weights::DecSoftmax::ToHalf(mblas::HalfType type) {
+  if (W4_.rows()) {
+    W4Half_ = mblas::HalfMatrix(W4_, type);
+    W4_ = mblas::WeightMatrix();
+  }
+}
+
+void Weights::DecSoftmax::FuseReadout() {
+  using namespace mblas;
+  if (Gamma_0_.rows() || Gamma_1_.rows() || Gamma_2_.rows()) {
+    return;
+  }
+  W123_ = WeightMatrix(Concat<byRow, Matrix>(Concat<byRow, Matrix>(W1_, W2_), W3_));
+  B123_ = WeightMatrix(B1_ + B2_ + B3_);
+}
+
+void Weights::DecSoftmax::ToInt8() {
+  if (W4Half_.rows()) {
+    mblas::Matrix W4;
+    mblas::ToFloat(W4, W4Half_);
+    W48_ = mblas::Int8Matrix(W4);
+    W4Half_ = mblas::HalfMatrix();
+  } else {
+    W48_ = mblas::Int8Matrix(W4_);
+    W4_ = mblas::WeightMatrix();
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 Weights::Weights(const NpzConverter& model, size_t)
@@ -93,6 +178,52 @@ Weights::Weights(const NpzConverter& model, size_t)
   decSoftmax_(model)
 {}
 
+void Weights::PrecomputeTables(size_t words, size_t budget, bool readout) {
+  using namespace mblas;
+  const size_t gruCols = decGru1_.W_.columns() + decGru1_.Wx_.columns();
+  const size_t readoutCols = readout ? decSoftmax_.W2_.columns() : 0;
+
+  const size_t vocab = decEmbeddings_.rows();
+  size_t rows = (words && words < vocab) ? words : vocab;
+  rows = std::min(rows, budget / ((gruCols + readoutCols) * sizeof(float)));
+  decTables_ = DecTables();
+  if (rows == 0) {
+    return;
+  }
+
+  std::vector<size_t> ids(rows);
+  std::iota(ids.begin(), ids.end(), 0);
+  Matrix Emb;
+  decEmbeddings_.Lookup(Emb, ids);
+  dl4mt::GRU<Weights::GRU>(decGru1_).GetInputProjection(decTables_.GRU_, Emb);
+
+  if (readout) {
+    // T2_ of Decoder::Softmax
+    decTables_.Readout_ = Emb * decSoftmax_.W2_;
+    if (decSoftmax_.Gamma_0_.rows()) {
+      LayerNormalization(decTables_.Readout_, decSoftmax_.Gamma_0_, decSoftmax_.B2_, 1e-9f);
+    } else {
+      AddBiasVector<byRow>(decTables_.Readout_, decSoftmax_.B2_);
+    }
+  }
+}
+
+void Weights::ToHalf(mblas::HalfType type) {
+  encEmbeddings_.ToHalf(type);
+  decEmbeddings_.ToHalf(type);
+  decSoftmax_.ToHalf(type);
+}
+
+void Weights::FuseReadout() {
+  decSoftmax_.FuseReadout();
+}
+
+void Weights::ToInt8() {
+  decGru1_.ToInt8();
+  decGru2_.ToInt8();
+  decSoftmax_.ToInt8();
+}
+
 }  // namespace dl4mt
 }  // namespace cpu
 }  // namespace amunmt
@@ -21,8 +21,8 @@ class Transition {
     {
       if (layerNormalization_) {
         for (int i = 0; i < w_.size(); ++i) {
-          Temp_1_ = state * w_.U_[i];
-          Temp_2_ = state * w_.Ux_[i];
+          mblas::Multiply(Temp_1_, state, w_.U_[i]);
+          mblas::Multiply(Temp_2_, state, w_.Ux_[i]);
 
           switch(w_.type()) {
             case Weights::Transition::TransitionType::Encoder:
@@ -44,8 +44,8 @@ class Transition {
         }
       } else {
         for (int i = 0; i < w_.size(); ++i) {
-          Temp_1_ = state * w_.U_[i];
-          Temp_2_ = state * w_.Ux_[i];
+          mblas::Multiply(Temp_1_, state, w_.U_[i]);
+          mblas::Multiply(Temp_2_, state, w_.Ux_[i]);
           mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.B_[i]);
           mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx1_[i]);
           ElementwiseOps(state, i);
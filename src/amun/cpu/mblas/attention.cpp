@@ -0,0 +1,39 @@
+#include "cpu/mblas/attention.h"
+#include "cpu/mblas/simd.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+void AttentionScores(float* out, size_t outStride,
+                     const float* scu, size_t scuStride, size_t words,
+                     const float* wh, size_t whStride, size_t rows,
+                     const float* v, size_t dim)
+{
+  // every source row is reused for all decoder states while it is in cache
+  for (size_t w = 0; w < words; ++w) {
+    const float* s = scu + w * scuStride;
+    for (size_t r = 0; r < rows; ++r) {
+      const float* h = wh + r * whStride;
+      float score = 0.0f;
+      size_t d = 0;
+#ifdef AMUN_SIMD
+      using namespace simd;
+      V acc = Simd::Set(0.0f);
+      for (; d + Simd::width <= dim; d += Simd::width) {
+        V t = Tanh(Simd::Add(Simd::Load(s + d), Simd::Load(h + d)));
+        acc = Simd::MulAdd(t, Simd::Load(v + d), acc);
+      }
+      score = Simd::Sum(acc);
+#endif
+      for (; d < dim; ++d) {
+        score += tanhapprox(s[d] + h[d]) * v[d];
+      }
+      out[r * outStride + w] = score;
+    }
+  }
+}
+
+}
+}
+}
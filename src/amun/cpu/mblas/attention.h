@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Additive attention scores of `rows` decoder states against `words` source
+// positions, dim values each:
+//   out[r * outStride + w] = sum_d tanh(scu[w * scuStride + d] + wh[r * whStride + d]) * v[d]
+// computed without materialising the (rows x words) x dim tanh argument.
+void AttentionScores(float* out, size_t outStride,
+                     const float* scu, size_t scuStride, size_t words,
+                     const float* wh, size_t whStride, size_t rows,
+                     const float* v, size_t dim);
+
+}
+}
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "cpu/mblas/gates.h"
+#include "cpu/mblas/simd.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+#ifdef AMUN_SIMD
+using namespace simd;
+
+// returns the number of units done, a multiple of the vector width
+template <bool Recurrent>
+size_t GRUGatesSimd(float* out, const float* state,
+                    const float* xr, const float* xu, const float* xh,
+                    const float* hr, const float* hu, const float* hh,
+                    size_t size)
+{
+  size_t i = 0;
+  for (; i + Simd::width <= size; i += Simd::width) {
+    V r = Simd::Load(xr + i);
+    V u = Simd::Load(xu + i);
+    if (Recurrent) {
+      r = Simd::Add(r, Simd::Load(hr + i));
+      u = Simd::Add(u, Simd::Load(hu + i));
+    }
+    r = Sigmoid(r);
+    u = Sigmoid(u);
+
+    V h = Tanh(Simd::MulAdd(r, Simd::Load(hh + i), Simd::Load(xh + i)));
+    V s = Simd::Load(state + i);
+    Simd::Store(out + i, Simd::MulAdd(u, s, Simd::Mul(Simd::Sub(Simd::Set(1.0f), u), h)));
+  }
+  return i;
+}
+#else
+template <bool Recurrent>
+size_t GRUGatesSimd(float*, const float*,
+                    const float*, const float*, const float*,
+                    const float*, const float*, const float*,
+                    size_t)
+{
+  return 0;
+}
+#endif
+
+template <bool Recurrent>
+void GRUGatesImpl(float* out, const float* state,
+                  const float* xr, const float* xu, const float* xh,
+                  const float* hr, const float* hu, const float* hh,
+                  size_t size)
+{
+  size_t i = GRUGatesSimd<Recurrent>(out, state, xr, xu, xh, hr, hu, hh, size);
+  for (; i < size; ++i) {
+    float r = logitapprox(Recurrent ? xr[i] + hr[i] : xr[i]);
+    float u = logitapprox(Recurrent ? xu[i] + hu[i] : xu[i]);
+    float h = tanhapprox(xh[i] + r * hh[i]);
+    out[i] = (1.0f - u) * h + u * state[i];
+  }
+}
+
+}
+
+void GRUGates(float* out, const float* state,
+              const float* xr, const float* xu, const float* xh,
+              const float* hr, const float* hu, const float* hh,
+              size_t size)
+{
+  if (hr) {
+    GRUGatesImpl<true>(out, state, xr, xu, xh, hr, hu, hh, size);
+  } else {
+    GRUGatesImpl<false>(out, state, xr, xu, xh, hr, hu, hh, size);
+  }
+}
+
+void AddBiasTanh(float* x, const float* bias, size_t size)
+{
+  size_t i = 0;
+#ifdef AMUN_SIMD
+  using namespace simd;
+  for (; i + Simd::width <= size; i += Simd::width) {
+    Simd::Store(x + i, Tanh(Simd::Add(Simd::Load(x + i), Simd::Load(bias + i))));
+  }
+#endif
+  for (; i < size; ++i) {
+    x[i] = tanhapprox(x[i] + bias[i]);
+  }
+}
+
+}
+}
+}
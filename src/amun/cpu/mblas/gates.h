@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// One GRU update of a row of `size` units, all arguments contiguous floats:
+//   r = sigmoid(xr + hr), u = sigmoid(xu + hu)
+//   out = (1 - u) * tanh(xh + r * hh) + u * state
+// Biases have to be folded into the inputs beforehand. hr and hu may both be
+// nullptr for gates without a recurrent part (deep transition cells), and out
+// may alias state. Uses AVX-512 or AVX2 when compiled for it and the same
+// approximations as simd_math_prims.h otherwise.
+void GRUGates(float* out, const float* state,
+              const float* xr, const float* xu, const float* xh,
+              const float* hr, const float* hu, const float* hh,
+              size_t size);
+
+// x = tanh(x + bias) over `size` contiguous floats, for the readout layer
+void AddBiasTanh(float* x, const float* bias, size_t size);
+
+}
+}
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cpu/mblas/half.h"
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+// Columns of B converted per panel, 128 x 512 floats fit into L2.
+const size_t PANEL = 128;
+
+typedef blaze::CustomMatrix<float, blaze::unaligned,
+                            blaze::unpadded, blaze::rowMajor> FloatWrapper;
+
+uint32_t Bits(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+float Float(uint32_t x) {
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+uint16_t FloatToFP16(float f) {
+  const uint32_t x = Bits(f);
+  const uint16_t sign = (x >> 16) & 0x8000;
+  const uint32_t abs = x & 0x7fffffff;
+  if (abs > 0x7f800000) {
+    return sign | 0x7e00;  // NaN
+  }
+  if (abs >= 0x477ff000) {
+    return sign | 0x7c00;  // rounds to or beyond infinity
+  }
+  if (abs < 0x38800000) {
+    // subnormal in fp16, multiples of 2^-24
+    return sign | (uint16_t)std::nearbyint(Float(abs) * 16777216.0f);
+  }
+  uint32_t h = (abs >> 13) - (112 << 10);
+  const uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+    ++h;
+  }
+  return sign | h;
+}
+
+float FP16ToFloat(uint16_t h) {
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1f;
+  const uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    float f = std::ldexp((float)mantissa, -24);
+    return sign ? -f : f;
+  }
+  if (exponent == 31) {
+    return Float(sign | 0x7f800000 | (mantissa << 13));
+  }
+  return Float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+uint16_t FloatToBF16(float f) {
+  const uint32_t x = Bits(f);
+  if ((x & 0x7fffffff) > 0x7f800000) {
+    return (x >> 16) | 0x40;  // keep NaN quiet
+  }
+  return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+float BF16ToFloat(uint16_t h) {
+  return Float((uint32_t)h << 16);
+}
+
+}
+
+HalfMatrix::HalfMatrix(const WeightMatrix& M, HalfType type)
+  : rows_(M.rows()),
+    cols_(M.columns()),
+    type_(type)
+{
+  auto storage = std::make_shared<std::vector<uint16_t>>(rows_ * cols_);
+  for (size_t i = 0; i < rows_; ++i) {
+    const float* in = M.data(i);
+    uint16_t* out = storage->data() + i * cols_;
+    for (size_t j = 0; j < cols_; ++j) {
+      out[j] = type_ == HalfType::FP16 ? FloatToFP16(in[j]) : FloatToBF16(in[j]);
+    }
+  }
+  data_ = storage->data();
+  storage_ = storage;
+}
+
+void HalfToFloat(float* out, const uint16_t* in, size_t size, HalfType type) {
+  size_t i = 0;
+  if (type == HalfType::FP16) {
+#if defined(__AVX512F__)
+    for (; i + 16 <= size; i += 16) {
+      _mm512_storeu_ps(out + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(in + i))));
+    }
+#elif defined(__F16C__)
+    for (; i + 8 <= size; i += 8) {
+      _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+    }
+#endif
+    for (; i < size; ++i) {
+      out[i] = FP16ToFloat(in[i]);
+    }
+  } else {
+    // bf16 is the upper half of an fp32, which is all that AVX-512 BF16's
+    // conversion does as well
+#if defined(__AVX512F__)
+    for (; i + 16 <= size; i += 16) {
+      __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(in + i)));
+      _mm512_storeu_ps(out + i, _mm512_castsi512_ps(_mm512_slli_epi32(x, 16)));
+    }
+#elif defined(__AVX2__)
+    for (; i + 8 <= size; i += 8) {
+      __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i)));
+      _mm256_storeu_ps(out + i, _mm256_castsi256_ps(_mm256_slli_epi32(x, 16)));
+    }
+#endif
+    for (; i < size; ++i) {
+      out[i] = BF16ToFloat(in[i]);
+    }
+  }
+}
+
+void ToFloat(Matrix& Out, const HalfMatrix& M) {
+  Reserve(Out, M.rows(), M.columns());
+  for (size_t i = 0; i < M.rows(); ++i) {
+    HalfToFloat(Out.data(i), M.row(i), M.columns(), M.type());
+  }
+}
+
+void AssembleRows(Matrix& Out, const HalfMatrix& M, const std::vector<size_t>& indices) {
+  Reserve(Out, indices.size(), M.columns());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    HalfToFloat(Out.data(i), M.row(indices[i]), M.columns(), M.type());
+  }
+}
+
+void AssembleColumns(Matrix& Out, const HalfMatrix& M, const std::vector<size_t>& indices) {
+  static thread_local std::vector<float> row;
+  row.resize(M.columns());
+  Reserve(Out, M.rows(), indices.size());
+  for (size_t i = 0; i < M.rows(); ++i) {
+    HalfToFloat(row.data(), M.row(i), M.columns(), M.type());
+    float* out = Out.data(i);
+    for (size_t j = 0; j < indices.size(); ++j) {
+      out[j] = row[indices[j]];
+    }
+  }
+}
+
+void HalfMultiply(float* C, size_t ldc, const float* A, size_t lda, size_t m,
+                  const HalfMatrix& B) {
+  static thread_local std::vector<float> panel;
+  const size_t k = B.rows();
+  panel.resize(k * PANEL);
+
+  FloatWrapper a(const_cast<float*>(A), m, k, lda);
+  FloatWrapper c(C, m, B.columns(), ldc);
+  for (size_t j = 0; j < B.columns(); j += PANEL) {
+    const size_t cols = std::min(PANEL, B.columns() - j);
+    for (size_t i = 0; i < k; ++i) {
+      HalfToFloat(panel.data() + i * cols, B.row(i) + j, cols, B.type());
+    }
+    FloatWrapper b(panel.data(), k, cols);
+    blaze::submatrix(c, 0, j, m, cols) = a * b;
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cpu/mblas/matrix.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+enum class HalfType {FP16, BF16};
+
+// Row-major 16 bit copy of a weight matrix, half the size of the fp32
+// original. Values are rounded to nearest even; bf16 keeps the fp32 range,
+// fp16 keeps three more mantissa bits. Like WeightMatrix, the values may be
+// borrowed from a memory-mapped model, and copies share them.
+class HalfMatrix {
+  public:
+    HalfMatrix()
+      : rows_(0), cols_(0), type_(HalfType::FP16), data_(nullptr)
+    {}
+
+    HalfMatrix(const WeightMatrix& M, HalfType type);
+
+    // rows x cols contiguous values kept alive by owner
+    HalfMatrix(const uint16_t* data, size_t rows, size_t cols, HalfType type,
+               std::shared_ptr<const void> owner)
+      : rows_(rows), cols_(cols), type_(type), data_(data), storage_(owner)
+    {}
+
+    size_t rows() const {
+      return rows_;
+    }
+
+    size_t columns() const {
+      return cols_;
+    }
+
+    HalfType type() const {
+      return type_;
+    }
+
+    const uint16_t* row(size_t i) const {
+      return data_ + i * cols_;
+    }
+
+  private:
+    size_t rows_;
+    size_t cols_;
+    HalfType type_;
+    const uint16_t* data_;
+    std::shared_ptr<const void> storage_;
+};
+
+// Converts size 16 bit values to fp32, with F16C or AVX-512 where available.
+void HalfToFloat(float* out, const uint16_t* in, size_t size, HalfType type);
+
+// Out = M converted back to fp32.
+void ToFloat(Matrix& Out, const HalfMatrix& M);
+
+// Out = M(indices, :) and Out = M(:, indices) in fp32.
+void AssembleRows(Matrix& Out, const HalfMatrix& M, const std::vector<size_t>& indices);
+void AssembleColumns(Matrix& Out, const HalfMatrix& M, const std::vector<size_t>& indices);
+
+// C = A * B for the m x B.rows() row-major A, with lda and ldc floats between
+// rows. B is converted to fp32 one panel of columns at a time into a thread
+// local buffer, which is then multiplied as an ordinary fp32 matrix.
+void HalfMultiply(float* C, size_t ldc, const float* A, size_t lda, size_t m,
+                  const HalfMatrix& B);
+
+inline void Multiply(Matrix& C, const Matrix& A, const HalfMatrix& B) {
+  Reserve(C, A.rows(), B.columns());
+  HalfMultiply(C.data(), C.spacing(), A.data(), A.spacing(), A.rows(), B);
+}
+
+inline void Multiply(ArrayMatrix& C, const Matrix& A, const HalfMatrix& B) {
+  Reserve(C, A.rows(), B.columns());
+  HalfMultiply(C.data(), C.spacing(), A.data(), A.spacing(), A.rows(), B);
+}
+
+}
+}
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cpu/mblas/int8.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+const size_t PADDING = 64;
+
+// Quantises size floats to [-127, 127] with scale max|x| / 127, which is
+// returned, and zero-pads out up to stride values.
+float Quantize(int8_t* out, const float* x, size_t xStride, size_t size, size_t stride) {
+  float max = 0.0f;
+  for (size_t i = 0; i < size; ++i) {
+    max = std::max(max, std::abs(x[i * xStride]));
+  }
+  float inv = max > 0.0f ? 127.0f / max : 0.0f;
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = (int8_t)std::max(-127.0f, std::min(127.0f, std::round(x[i * xStride] * inv)));
+  }
+  std::fill(out + size, out + stride, 0);
+  return max / 127.0f;
+}
+
+// Dot product of stride int8 values, stride being a multiple of PADDING.
+// Neither side may hold -128, so |a| * (b with the sign of a) is exact and
+// two such products still fit the int16 lanes of maddubs.
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+int32_t Dot(const int8_t* a, const int8_t* b, size_t stride) {
+  __m512i acc = _mm512_setzero_si512();
+  for (size_t i = 0; i < stride; i += 64) {
+    __m512i va = _mm512_loadu_si512(a + i);
+    __m512i vb = _mm512_loadu_si512(b + i);
+    __m512i sb = _mm512_mask_sub_epi8(vb, _mm512_movepi8_mask(va), _mm512_setzero_si512(), vb);
+    acc = _mm512_dpbusd_epi32(acc, _mm512_abs_epi8(va), sb);
+  }
+  return _mm512_reduce_add_epi32(acc);
+}
+#elif defined(__AVX2__)
+int32_t Dot(const int8_t* a, const int8_t* b, size_t stride) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc = _mm256_setzero_si256();
+  for (size_t i = 0; i < stride; i += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+    __m256i p = _mm256_maddubs_epi16(_mm256_sign_epi8(va, va), _mm256_sign_epi8(vb, va));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(p, ones));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+#else
+int32_t Dot(const int8_t* a, const int8_t* b, size_t stride) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < stride; ++i) {
+    sum += (int32_t)a[i] * (int32_t)b[i];
+  }
+  return sum;
+}
+#endif
+
+struct Int8Buffer {
+  std::vector<int8_t> rows_;
+  std::vector<float> scales_;
+};
+
+}
+
+Int8Matrix::Int8Matrix(const float* B, size_t rows, size_t cols, size_t ldb)
+  : rows_(rows),
+    cols_(cols),
+    stride_((rows + PADDING - 1) / PADDING * PADDING),
+    data_(cols_ * stride_),
+    scales_(cols_)
+{
+  for (size_t j = 0; j < cols_; ++j) {
+    scales_[j] = Quantize(data_.data() + j * stride_, B + j, ldb, rows_, stride_);
+  }
+}
+
+void AssembleColumns(Int8Matrix& Out, const Int8Matrix& M, const std::vector<size_t>& indices) {
+  Out.rows_ = M.rows_;
+  Out.cols_ = indices.size();
+  Out.stride_ = M.stride_;
+  Out.data_.resize(Out.cols_ * Out.stride_);
+  Out.scales_.resize(Out.cols_);
+  for (size_t j = 0; j < indices.size(); ++j) {
+    std::copy(M.column(indices[j]), M.column(indices[j]) + M.stride_,
+              Out.data_.begin() + j * Out.stride_);
+    Out.scales_[j] = M.scales_[indices[j]];
+  }
+}
+
+void Int8Multiply(float* C, size_t ldc, const float* A, size_t lda, size_t m,
+                  const Int8Matrix& B) {
+  static thread_local Int8Buffer buffer;
+  const size_t stride = B.stride();
+  buffer.rows_.resize(m * stride);
+  buffer.scales_.resize(m);
+  for (size_t i = 0; i < m; ++i) {
+    buffer.scales_[i] = Quantize(buffer.rows_.data() + i * stride, A + i * lda, 1, B.rows(), stride);
+  }
+
+  // columns outside, so that each column of B is read once for all rows of A
+  for (size_t j = 0; j < B.columns(); ++j) {
+    const int8_t* b = B.column(j);
+    const float scale = B.scale(j);
+    for (size_t i = 0; i < m; ++i) {
+      C[i * ldc + j] = scale * buffer.scales_[i] * Dot(buffer.rows_.data() + i * stride, b, stride);
+    }
+  }
+}
+
+}
+}
+}
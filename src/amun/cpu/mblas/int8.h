@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu/mblas/matrix.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Int8 copy of a k x n weight matrix B for products A * B. Every column is
+// quantised with its own scale max|B(:, j)| / 127 and stored contiguously,
+// zero-padded to a multiple of 64 values.
+class Int8Matrix {
+  public:
+    Int8Matrix()
+      : rows_(0), cols_(0), stride_(0)
+    {}
+
+    template <class MT>
+    explicit Int8Matrix(const MT& B)
+      : Int8Matrix(B.data(), B.rows(), B.columns(), B.spacing())
+    {}
+
+    // B with ldb floats between rows
+    Int8Matrix(const float* B, size_t rows, size_t cols, size_t ldb);
+
+    size_t rows() const {
+      return rows_;
+    }
+
+    size_t columns() const {
+      return cols_;
+    }
+
+    size_t stride() const {
+      return stride_;
+    }
+
+    const int8_t* column(size_t j) const {
+      return data_.data() + j * stride_;
+    }
+
+    float scale(size_t j) const {
+      return scales_[j];
+    }
+
+    friend void AssembleColumns(Int8Matrix& Out, const Int8Matrix& M,
+                                const std::vector<size_t>& indices);
+
+  private:
+    size_t rows_;
+    size_t cols_;
+    size_t stride_;
+    std::vector<int8_t> data_;
+    std::vector<float> scales_;
+};
+
+// Out = M(:, indices), copied as quantised. Scales are per column, so this is
+// exactly the int8 copy of the same columns of the fp32 matrix. Out keeps its
+// storage between calls.
+void AssembleColumns(Int8Matrix& Out, const Int8Matrix& M, const std::vector<size_t>& indices);
+
+// C = A * B for the m x B.rows() row-major A, with lda and ldc floats between
+// rows. Rows of A are quantised on the fly with their own scale, products are
+// summed in int32 (AVX-512 VNNI, AVX2 maddubs or scalar code) and scaled back.
+void Int8Multiply(float* C, size_t ldc, const float* A, size_t lda, size_t m,
+                  const Int8Matrix& B);
+
+inline void Multiply(Matrix& C, const Matrix& A, const Int8Matrix& B) {
+  Reserve(C, A.rows(), B.columns());
+  Int8Multiply(C.data(), C.spacing(), A.data(), A.spacing(), A.rows(), B);
+}
+
+inline void Multiply(ArrayMatrix& C, const Matrix& A, const Int8Matrix& B) {
+  Reserve(C, A.rows(), B.columns());
+  Int8Multiply(C.data(), C.spacing(), A.data(), A.spacing(), A.rows(), B);
+}
+
+}
+}
+}
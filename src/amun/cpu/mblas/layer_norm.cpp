@@ -0,0 +1,101 @@
+#include <cmath>
+#include <algorithm>
+
+#include "cpu/mblas/layer_norm.h"
+#include "cpu/mblas/simd.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+inline float Value(const float* x, const float* bias, size_t i) {
+  return bias ? x[i] + bias[i] : x[i];
+}
+
+// Sums of (x - shift) and its square. The shift, an element of the row, keeps
+// the variance from cancelling out when the mean is large.
+void ShiftedSums(const float* x, const float* bias, size_t cols, float shift,
+                 float& sum, float& sumSq)
+{
+  sum = 0.0f;
+  sumSq = 0.0f;
+  size_t i = 0;
+#ifdef AMUN_SIMD
+  using namespace simd;
+  V vShift = Simd::Set(shift);
+  V vSum = Simd::Set(0.0f);
+  V vSumSq = Simd::Set(0.0f);
+  for (; i + Simd::width <= cols; i += Simd::width) {
+    V v = Simd::Load(x + i);
+    if (bias) {
+      v = Simd::Add(v, Simd::Load(bias + i));
+    }
+    v = Simd::Sub(v, vShift);
+    vSum = Simd::Add(vSum, v);
+    vSumSq = Simd::MulAdd(v, v, vSumSq);
+  }
+  sum = Simd::Sum(vSum);
+  sumSq = Simd::Sum(vSumSq);
+#endif
+  for (; i < cols; ++i) {
+    float v = Value(x, bias, i) - shift;
+    sum += v;
+    sumSq += v * v;
+  }
+}
+
+void Normalize(float* x, const float* bias, const float* gamma, const float* beta,
+               size_t cols, float mean, float invSigma)
+{
+  size_t i = 0;
+#ifdef AMUN_SIMD
+  using namespace simd;
+  V vMean = Simd::Set(mean);
+  V vInv = Simd::Set(invSigma);
+  for (; i + Simd::width <= cols; i += Simd::width) {
+    V v = Simd::Load(x + i);
+    if (bias) {
+      v = Simd::Add(v, Simd::Load(bias + i));
+    }
+    v = Simd::Mul(Simd::Mul(Simd::Sub(v, vMean), vInv), Simd::Load(gamma + i));
+    if (beta) {
+      v = Simd::Add(v, Simd::Load(beta + i));
+    }
+    Simd::Store(x + i, v);
+  }
+#endif
+  for (; i < cols; ++i) {
+    float v = gamma[i] * ((Value(x, bias, i) - mean) * invSigma);
+    x[i] = beta ? v + beta[i] : v;
+  }
+}
+
+}
+
+void LayerNorm(float* in, size_t stride, size_t rows, size_t cols,
+               const float* bias, const float* gamma, const float* beta, float eps)
+{
+  if (cols == 0) {
+    return;
+  }
+
+  for (size_t j = 0; j < rows; ++j) {
+    float* x = in + j * stride;
+
+    float shift = Value(x, bias, 0);
+    float sum, sumSq;
+    ShiftedSums(x, bias, cols, shift, sum, sumSq);
+
+    float mean = sum / cols;
+    float variance = std::max(0.0f, sumSq / cols - mean * mean);
+    float invSigma = 1.0f / std::sqrt(variance + eps);
+
+    Normalize(x, bias, gamma, beta, cols, shift + mean, invSigma);
+  }
+}
+
+}
+}
+}
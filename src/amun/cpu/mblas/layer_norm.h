@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Layer normalisation of `rows` rows of `cols` values, `stride` floats apart,
+// in place:
+//   x = in + bias
+//   in = gamma * (x - mean(x)) / sqrt(var(x) + eps) + beta
+// bias, gamma and beta hold cols contiguous values; bias and beta may be
+// nullptr. Each row is read twice, once for its mean and variance (shifted
+// sums) and once to normalise it.
+void LayerNorm(float* in, size_t stride, size_t rows, size_t cols,
+               const float* bias, const float* gamma, const float* beta, float eps);
+
+}
+}
+}
@@ -18,6 +18,16 @@ namespace CPU {
 
 namespace mblas {
 
+size_t& Allocations() {
+  static thread_local size_t allocations = 0;
+  return allocations;
+}
+
+Workspace& GetWorkspace() {
+  static thread_local Workspace workspace;
+  return workspace;
+}
+
 }
 }
 }
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <sstream>
 
 #include <blaze/Math.h>
+#include <blaze/util/policies/Deallocate.h>
 #include "phoenix_functions.h"
+#include "layer_norm.h"
+#include "softmax.h"
 #include "common/base_matrix.h"
 #include "common/exception.h"
 
@@ -175,6 +180,76 @@ class ArrayMatrix : public BlazeMatrix<float, blaze::rowMajor>
 
 };
 
+////////////////////////////////////////////////////////////////////////
+// Read-only model matrix. It either owns its storage, aligned and spaced like
+// a DynamicMatrix, or borrows it from a memory-mapped model (see
+// cpu/binary_model.h) that owner keeps alive. Copies share the storage.
+class WeightMatrix : public blaze::CustomMatrix<float, blaze::aligned, blaze::unpadded,
+                                                blaze::rowMajor>
+{
+  public:
+    typedef blaze::CustomMatrix<float, blaze::aligned, blaze::unpadded,
+                                blaze::rowMajor> Parent;
+
+    WeightMatrix()
+      : Parent()
+    {}
+
+    // rows x cols zeros
+    WeightMatrix(size_t rows, size_t cols)
+      : Parent()
+    {
+      if (rows * cols == 0) {
+        return;
+      }
+      const size_t spacing = blaze::nextMultiple<size_t>(cols, blaze::SIMDTrait<float>::size);
+      float* data = blaze::allocate<float>(rows * spacing);
+      std::fill(data, data + rows * spacing, 0.0f);
+      Parent::reset(data, rows, cols, spacing, blaze::Deallocate());
+    }
+
+    // owned copy of m
+    template <class MT, bool SO>
+    WeightMatrix(const blaze::Matrix<MT, SO>& m)
+      : WeightMatrix((~m).rows(), (~m).columns())
+    {
+      if (Parent::rows()) {
+        Parent::operator=(~m);
+      }
+    }
+
+    WeightMatrix(const float* data, size_t rows, size_t cols, size_t spacing,
+                 std::shared_ptr<const void> owner)
+      : Parent(const_cast<float*>(data), rows, cols, spacing, KeepAlive{owner})
+    {}
+
+    WeightMatrix(const WeightMatrix&) = default;
+    WeightMatrix(WeightMatrix&&) = default;
+
+    // shares the storage of m instead of copying its values
+    WeightMatrix& operator=(const WeightMatrix& m) {
+      WeightMatrix(m).swap(*this);
+      return *this;
+    }
+
+    WeightMatrix& operator=(WeightMatrix&& m) {
+      Parent::operator=(std::move(m));
+      return *this;
+    }
+
+    void swap(WeightMatrix& m) {
+      std::swap(static_cast<Parent&>(*this), static_cast<Parent&>(m));
+    }
+
+  private:
+    // deleter of borrowed storage, which holds on to its owner instead
+    struct KeepAlive {
+      std::shared_ptr<const void> owner_;
+
+      void operator()(float*) const {}
+    };
+};
+
 ////////////////////////////////////////////////////////////////////////
 template <class M>
 std::string Debug(const M& m)
@@ -193,6 +268,48 @@ std::string Debug(const M& m)
   return strm.str();
 }
 
+// Number of times the storage of a matrix sized through Reserve had to be
+// reallocated on the calling thread. The decoding loop sizes all its scratch
+// and output matrices this way, GEMM results included (see Multiply), and the
+// scorer keeps them, decoder states included, from one batch to the next. Once
+// it has seen its largest batch, sentence and beam shapes, this stays put.
+size_t& Allocations();
+
+// Resizes m to rows x cols without keeping its contents. Storage is only
+// reallocated, and counted in Allocations, if it is too small.
+template <class MT>
+void Reserve(MT& m, size_t rows, size_t cols) {
+  const size_t capacity = m.capacity();
+  m.resize(rows, cols, false);
+  if (m.capacity() != capacity) {
+    ++Allocations();
+  }
+}
+
+inline void Reserve(ArrayMatrix& m, size_t rows, size_t cols) {
+  const float* data = m.data();
+  m.Resize(rows, cols);
+  if (m.data() != data) {
+    ++Allocations();
+  }
+}
+
+// C = A * B with C sized through Reserve. See half.h and int8.h for the
+// products with converted weights.
+template <class MT1, class MT2>
+void Multiply(Matrix& C, const MT1& A, const MT2& B) {
+  Reserve(C, A.rows(), B.columns());
+  C = A * B;
+}
+
+// Assigned through the view: ArrayMatrix's own assignment would build the
+// product in a new temporary and take over its storage.
+template <class MT1, class MT2>
+void Multiply(ArrayMatrix& C, const MT1& A, const MT2& B) {
+  Reserve(C, A.rows(), B.columns());
+  static_cast<ArrayMatrix::BlazeBase&>(C) = A * B;
+}
+
 template <bool byRow, class MT, class VT>
 MT& AddBiasVector(MT& m, const VT& b) {
   if(byRow) {
@@ -225,13 +342,15 @@ void Reshape(MT& m, size_t rows, size_t cols) {
   temp.swap(m);
 }
 
+// The helpers below come in two forms: one writing into out, which keeps its
+// storage between calls (see Reserve), and one returning a new matrix for
+// code outside the decoding loop.
 template <bool byRow, class MT, class MT1>
-MT Mean(const MT1& in) {
-  MT out;
+void Mean(MT& out, const MT1& in) {
   if(byRow) {
     size_t rows = in.rows();
     size_t cols = in.columns();
-    out.resize(1, cols);
+    Reserve(out, 1, cols);
     blaze::row(out, 0) = blaze::row(in, 0);
     for(size_t i = 1; i < rows; ++i)
       blaze::row(out, 0) += blaze::row(in, i);
@@ -240,13 +359,19 @@ MT Mean(const MT1& in) {
   else {
     size_t rows = in.rows();
     size_t cols = in.columns();
-    out.resize(rows, 1);
+    Reserve(out, rows, 1);
     blaze::column(out, 0) = blaze::column(in, 0);
     for(size_t i = 1; i < cols; ++i)
       blaze::column(out, 0) += blaze::column(in, i);
     out *= 1.0f / cols;
   }
-  return std::move(out);
+}
+
+template <bool byRow, class MT, class MT1>
+MT Mean(const MT1& in) {
+  MT out;
+  Mean<byRow>(out, in);
+  return out;
 }
 
 typedef std::pair<size_t, size_t> RowPair;
@@ -257,122 +382,169 @@ const bool byRow = true;
 const bool byColumn = false;
 
 template <bool byRow, class MT, class MT1, class MT2>
-MT Concat(const MT1& m1, const MT2& m2) {
-  MT out = m1;
+void Concat(MT& out, const MT1& m1, const MT2& m2) {
   if(byRow) {
     assert(m1.columns() == m2.columns());
     size_t rows1 = m1.rows();
     size_t rows2 = m2.rows();
-    size_t rows = rows1 + rows2;
     size_t cols = m1.columns();
-    out.resize(rows, cols);
-    for(size_t i = 0; i < rows2; ++i)
-      blaze::row(out, rows1 + i) = blaze::row(m2, i);
+    Reserve(out, rows1 + rows2, cols);
+    blaze::submatrix(out, 0, 0, rows1, cols) = m1;
+    blaze::submatrix(out, rows1, 0, rows2, cols) = m2;
   }
   else {
     assert(m1.rows() == m2.rows());
     size_t cols1 = m1.columns();
     size_t cols2 = m2.columns();
-    size_t cols = cols1 + cols2;
     size_t rows = m1.rows();
-    out.resize(rows, cols);
-    for(size_t i = 0; i < cols2; ++i)
-      blaze::column(out, cols1 + i) = blaze::column(m2, i);
+    Reserve(out, rows, cols1 + cols2);
+    blaze::submatrix(out, 0, 0, rows, cols1) = m1;
+    blaze::submatrix(out, 0, cols1, rows, cols2) = m2;
   }
-  return std::move(out);
 }
 
-template <bool byRow, class MT, class MT1>
-MT Assemble(const MT1& in,
-            const std::vector<size_t>& indices) {
+template <bool byRow, class MT, class MT1, class MT2>
+MT Concat(const MT1& m1, const MT2& m2) {
   MT out;
+  Concat<byRow>(out, m1, m2);
+  return out;
+}
+
+template <bool byRow, class MT, class MT1>
+void Assemble(MT& out, const MT1& in,
+              const std::vector<size_t>& indices) {
   if(byRow) {
     size_t rows = indices.size();
     size_t cols = in.columns();
-    out.resize(rows, cols);
+    Reserve(out, rows, cols);
     for(size_t i = 0; i < rows; ++i)
       blaze::row(out, i) = blaze::row(in, indices[i]);
   }
   else {
     size_t rows = in.rows();
     size_t cols = indices.size();
-    out.resize(rows, cols);
+    Reserve(out, rows, cols);
     for(size_t i = 0; i < cols; ++i)
       blaze::column(out, i) = blaze::column(in, indices[i]);
   }
-  return std::move(out);
 }
 
+template <bool byRow, class MT, class MT1>
+MT Assemble(const MT1& in,
+            const std::vector<size_t>& indices) {
+  MT out;
+  Assemble<byRow>(out, in, indices);
+  return out;
+}
+
+// Scratch space of the calling thread for temporaries inside the helpers
+// here. It keeps its storage between calls like any Reserve'd matrix.
+struct Workspace {
+  Matrix In_;
+  Matrix Out_;
+  std::vector<size_t> rows_;
+};
+
+Workspace& GetWorkspace();
+
+// Row-wise softmax and log-softmax, see softmax.h. Row maxima are subtracted
+// before exponentiating, so large logits do not overflow.
 template <class MT>
 void SafeSoftmax(MT& Out) {
-  size_t rows = Out.rows();
-  size_t cols = Out.columns();
-  float sum[rows];
-  for (int j = 0; j < rows; ++j) {
-    float maxRowValue = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      maxRowValue = std::max(maxRowValue, Out(j,i));
-    }
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      Out(j, i) = expapprox(Out(j, i) - maxRowValue);
-      sum[j] += Out(j, i);
-    }
-    for(int i = 0; i < cols; ++i) {
-      Out(j, i) /= sum[j];
-    }
-  }
+  SoftmaxRows(Out.data(), Out.spacing(), Out.rows(), Out.columns());
+}
+
+template <class MT>
+void Softmax(MT& Out) {
+  SoftmaxRows(Out.data(), Out.spacing(), Out.rows(), Out.columns());
 }
 
 template <class MT>
 void LogSoftmax(MT& Out) {
-  size_t rows = Out.rows();
-  size_t cols = Out.columns();
-  float sum[rows];
-  for (int j = 0; j < rows; ++j) {
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      sum[j] += expapprox(Out(j, i));
-    }
-    for(int i = 0; i < cols; ++i) {
-      Out(j, i) -= logapprox(sum[j]);
-    }
-  }
+  LogSoftmaxRows(Out.data(), Out.spacing(), Out.rows(), Out.columns(), nullptr);
+}
+
+// AddBiasVector<byRow>(Out, bias) followed by LogSoftmax, in one pass less
+template <class MT, class BT>
+void AddBiasLogSoftmax(MT& Out, const BT& bias) {
+  amunmt_UTIL_THROW_IF2(bias.rows() != 1 || bias.columns() != Out.columns(),
+                        "Softmax bias has to be a row of the same width");
+  LogSoftmaxRows(Out.data(), Out.spacing(), Out.rows(), Out.columns(), bias.data());
 }
 
+// Moves the first newBlockRows rows of block keep[i] (blocks of blockRows rows)
+// to block i and drops the rest. keep must be increasing and newBlockRows
+// must not exceed blockRows, so rows only move towards the top.
 template <class MT>
-void Softmax(MT& Out) {
-  size_t rows = Out.rows();
-  size_t cols = Out.columns();
-  float sum[rows];
-  for (int j = 0; j < rows; ++j) {
-    float maxRowValue = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      maxRowValue = std::max(maxRowValue, Out(j,i));
+void CompactRowBlocks(MT& M, const std::vector<size_t>& keep,
+                      size_t blockRows, size_t newBlockRows) {
+  for (size_t i = 0; i < keep.size(); ++i) {
+    if (i * newBlockRows == keep[i] * blockRows) {
+      continue;
     }
-
-    sum[j] = 0;
-    for (int i = 0; i < cols; ++i) {
-      Out(j,i) = expapprox(Out(j, i) - maxRowValue);
-      sum[j] += Out(j, i);
+    for (size_t r = 0; r < newBlockRows; ++r) {
+      blaze::row(M, i * newBlockRows + r) = blaze::row(M, keep[i] * blockRows + r);
     }
+  }
+  // a preserving resize would always reallocate; fewer rows of the same width
+  // fit in place and keep the leading rows as they are
+  Reserve(M, keep.size() * newBlockRows, M.columns());
+}
 
-    for(int i = 0; i < cols; ++i) {
-      Out(j, i) /= sum[j];
+// Out = project(In) for a row-wise projection of word embeddings: row i of
+// In embeds words[i], and row w of Table, if there is one, already holds the
+// projection of word w. Covered rows are copied from Table, project only runs
+// on the rest.
+template <class Project>
+void ProjectWords(Matrix& Out, const Matrix& In, const std::vector<size_t>& words,
+                  const Matrix& Table, const Project& project) {
+  Workspace& ws = GetWorkspace();
+  std::vector<size_t>& rest = ws.rows_;
+  rest.clear();
+  Reserve(Out, words.size(), Table.columns());
+  for (size_t i = 0; i < words.size(); ++i) {
+    if (words[i] < Table.rows()) {
+      blaze::row(Out, i) = blaze::row(Table, words[i]);
+    } else {
+      rest.push_back(i);
     }
   }
+  if (rest.empty()) {
+    return;
+  }
+  Assemble<byRow>(ws.In_, In, rest);
+  project(ws.Out_, ws.In_);
+  for (size_t i = 0; i < rest.size(); ++i) {
+    blaze::row(Out, rest[i]) = blaze::row(ws.Out_, i);
+  }
+}
+
+// Per-row log-partition of In, i.e. what LogSoftmax would subtract from each row.
+template <class MT>
+void LogSumExp(MT& In, std::vector<float>& Out) {
+  Out.resize(In.rows());
+  LogSumExpRows(In.data(), In.spacing(), In.rows(), In.columns(), nullptr, Out.data());
+}
+
+// AddBiasVector<byRow>(In, bias) followed by LogSumExp; In keeps the biased logits
+template <class MT, class BT>
+void AddBiasLogSumExp(MT& In, const BT& bias, std::vector<float>& Out) {
+  amunmt_UTIL_THROW_IF2(bias.rows() != 1 || bias.columns() != In.columns(),
+                        "Softmax bias has to be a row of the same width");
+  Out.resize(In.rows());
+  LogSumExpRows(In.data(), In.spacing(), In.rows(), In.columns(), bias.data(), Out.data());
 }
 
 template <class MT, class Functor, class MT1, class MT2>
-MT Broadcast(const Functor& functor, const MT1& m1, const MT2& m2) {
+void Broadcast(MT& out, const Functor& functor, const MT1& m1, const MT2& m2) {
   size_t rows1 = m1.rows();
   size_t rows2 = m2.rows();
 
   size_t rows = rows1 * rows2;
   size_t cols = m1.columns();
 
-  MT out(rows, cols);
-  for (int j = 0; j < rows; ++j) {
+  Reserve(out, rows, cols);
+  for (size_t j = 0; j < rows; ++j) {
     size_t r1 = j % rows1;
     size_t r2 = j / rows1;
 
@@ -380,83 +552,36 @@ MT Broadcast(const Functor& functor, const MT1& m1, const MT2& m2) {
       blaze::forEach(blaze::row(m1, r1) + blaze::row(m2, r2),
                      functor);
   }
-  return std::move(out);
 }
 
-template<class MT>
-void LayerNormalization(MT& in, const MT& gamma, const MT& beta, float eps=1e-5f) {
-  eps=1e-5f;
-  // std::cerr << "LAYER NORM" << std::endl;
-  // std::cerr << std::endl;
-  size_t rows = in.rows();
-  size_t cols = in.columns();
-
-  for (int j = 0; j < rows; ++j) {
-    // std::cerr << "PRE ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << in(j, i) << " ";
-    // }
-    // std::cerr << std::endl;
-    //
-    float sum = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sum += in(j, i);
-    }
-
-    float mean = sum / cols;
-
-    float sigma = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sigma += (in(j, i) - mean) * (in(j, i) - mean);
-    }
-    sigma /= cols;
-
-    sigma = sqrt(sigma + eps);
-
-    // std::cerr << "MIDD ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << ( (in(j, i) - mean) / sigma) << " ";
-    // }
-    // std::cerr << std::endl;
-
-    for (int i = 0; i < cols; ++i) {
-      in(j, i) = gamma(i, 0) * ( (in(j, i) - mean) / sigma) + beta(i, 0);
-    }
-
-    // std::cerr << "POST ";
-    // for (int i = 0; i < 10; ++i) {
-      // std::cerr << in(j, i) << " ";
-    // }
-    // std::cerr << std::endl;
-  }
-  // std::cerr << "LAYER NORM: DONE" << std::endl;
+template <class MT, class Functor, class MT1, class MT2>
+MT Broadcast(const Functor& functor, const MT1& m1, const MT2& m2) {
+  MT out;
+  Broadcast(out, functor, m1, m2);
+  return out;
 }
 
-template<class MT>
-void LayerNormalization(MT& in, const MT& gamma, float eps=1e-9) {
-  size_t rows = in.rows();
-  size_t cols = in.columns();
-
-  for (int j = 0; j < rows; ++j) {
-    float sum = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sum += in(j, i);
-    }
-
-    float mean = sum / cols;
-
-    float sigma = 0.0f;
-    for (int i = 0; i < cols; ++i) {
-      sigma += (in(j, i) - mean) * (in(j, i) - mean);
-    }
-    sigma /= cols;
+// Layer normalisation of every row of in (see LayerNorm). gamma, beta and
+// bias are 1 x in.columns() rows, as returned by NpzConverter with transpose.
+template<class MT, class MT1, class MT2>
+void LayerNormalization(MT& in, const MT1& gamma, const MT2& beta, float eps=1e-5f) {
+  amunmt_UTIL_THROW_IF2(gamma.rows() != 1 || beta.rows() != 1, "Layer normalisation parameters have to be rows");
+  LayerNorm(in.data(), in.spacing(), in.rows(), in.columns(), nullptr, gamma.data(), beta.data(), eps);
+}
 
-    sigma = sqrt(sigma + eps);
+template<class MT, class MT1>
+void LayerNormalization(MT& in, const MT1& gamma, float eps=1e-9) {
+  amunmt_UTIL_THROW_IF2(gamma.rows() != 1, "Layer normalisation parameters have to be rows");
+  LayerNorm(in.data(), in.spacing(), in.rows(), in.columns(), nullptr, gamma.data(), nullptr, eps);
+}
 
-    for (int i = 0; i < cols; ++i) {
-      in(j, i) = gamma(i, 0) * ( (in(j, i) - mean) / sigma);
-    }
-  }
+// AddBiasVector<byRow>(in, bias) followed by LayerNormalization, in one pass less
+template<class MT, class MT1, class MT2, class MT3>
+void AddBiasLayerNormalization(MT& in, const MT1& bias, const MT2& gamma, const MT3& beta,
+                               float eps=1e-5f) {
+  amunmt_UTIL_THROW_IF2(bias.rows() != 1 || gamma.rows() != 1 || beta.rows() != 1,
+                        "Layer normalisation parameters have to be rows");
+  LayerNorm(in.data(), in.spacing(), in.rows(), in.columns(), bias.data(), gamma.data(), beta.data(), eps);
 }
 
 }
@@ -0,0 +1,163 @@
+#include <algorithm>
+
+#include "cpu/mblas/nth_element.h"
+#include "cpu/mblas/simd.h"
+
+using namespace std;
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+// Orders the heap so that its front is the worst of the kept candidates.
+// Equal costs prefer the smaller key, which makes the result deterministic.
+struct BetterCost {
+  bool operator()(const pair<float, size_t>& a, const pair<float, size_t>& b) const {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  }
+};
+
+#ifndef AMUN_SIMD
+// Elements are compared against the threshold in blocks of this size. The inner
+// loop has no branches and is left to the compiler.
+const size_t BLOCK_SIZE = 16;
+#endif
+
+}
+
+NthElement::NthElement(size_t maxBeamSize)
+  : k_(0)
+{
+  heap_.reserve(maxBeamSize);
+}
+
+void NthElement::getNBestList(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                              const ArrayMatrix& Probs,
+                              std::vector<float>& outCosts, std::vector<size_t>& outKeys)
+{
+  const size_t vocabSize = Probs.columns();
+  const float* data = Probs.data();
+
+  size_t rowOffset = 0;
+  for (size_t batchId = 0; batchId < beamSizes.size(); ++batchId) {
+    size_t rows = rowSizes[batchId];
+    Reset(beamSizes[batchId]);
+    Scan(data + rowOffset * vocabSize, rows * vocabSize, rowOffset * vocabSize, 0.0f, 1.0f, 0.0f);
+    Flush(outCosts, outKeys);
+    rowOffset += rows;
+  }
+}
+
+void NthElement::getNBestList(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                              const ArrayMatrix& Probs,
+                              const std::vector<float>& logNorms, float scale,
+                              const std::vector<float>& costs,
+                              std::vector<float>& outCosts, std::vector<size_t>& outKeys)
+{
+  const size_t vocabSize = Probs.columns();
+  const float* data = Probs.data();
+
+  size_t rowOffset = 0;
+  for (size_t batchId = 0; batchId < beamSizes.size(); ++batchId) {
+    size_t rows = rowSizes[batchId];
+    Reset(beamSizes[batchId]);
+    for (size_t row = rowOffset; row < rowOffset + rows; ++row) {
+      Scan(data + row * vocabSize, vocabSize, row * vocabSize, logNorms[row], scale, costs[row]);
+    }
+    Flush(outCosts, outKeys);
+    rowOffset += rows;
+  }
+}
+
+void NthElement::Reset(size_t k)
+{
+  k_ = k;
+  heap_.clear();
+}
+
+void NthElement::Scan(const float* data, size_t size, size_t offset,
+                      float norm, float scale, float bias)
+{
+  BetterCost better;
+
+  size_t i = 0;
+  for (; i < size && heap_.size() < k_; ++i) {
+    heap_.emplace_back(scale * (data[i] - norm) + bias, offset + i);
+    push_heap(heap_.begin(), heap_.end(), better);
+  }
+  if (k_ == 0 || i == size) {
+    return;
+  }
+
+  // keys only grow during the scan, so an equal cost never beats the threshold
+  float threshold = heap_.front().first;
+  auto insert = [&](float cost, size_t pos) {
+    pop_heap(heap_.begin(), heap_.end(), better);
+    heap_.back() = CostKey(cost, offset + pos);
+    push_heap(heap_.begin(), heap_.end(), better);
+    threshold = heap_.front().first;
+  };
+
+#ifdef AMUN_SIMD
+  using namespace simd;
+  V vNorm = Simd::Set(norm);
+  V vScale = Simd::Set(scale);
+  V vBias = Simd::Set(bias);
+  float costs[Simd::width];
+  for (; i + Simd::width <= size; i += Simd::width) {
+    V v = Simd::MulAdd(vScale, Simd::Sub(Simd::Load(data + i), vNorm), vBias);
+    if (!Simd::AnyGreater(v, Simd::Set(threshold))) {
+      continue;
+    }
+
+    // the heap gets the costs of the register, so both tests agree
+    Simd::Store(costs, v);
+    for (size_t j = 0; j < Simd::width; ++j) {
+      if (costs[j] > threshold) {
+        insert(costs[j], i + j);
+      }
+    }
+  }
+#else
+  for (; i + BLOCK_SIZE <= size; i += BLOCK_SIZE) {
+    const float* block = data + i;
+    bool any = false;
+    for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+      any |= (scale * (block[j] - norm) + bias > threshold);
+    }
+    if (!any) {
+      continue;
+    }
+
+    for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+      float cost = scale * (block[j] - norm) + bias;
+      if (cost > threshold) {
+        insert(cost, i + j);
+      }
+    }
+  }
+#endif
+
+
+  for (; i < size; ++i) {
+    float cost = scale * (data[i] - norm) + bias;
+    if (cost > threshold) {
+      insert(cost, i);
+    }
+  }
+}
+
+void NthElement::Flush(std::vector<float>& outCosts, std::vector<size_t>& outKeys)
+{
+  sort_heap(heap_.begin(), heap_.end(), BetterCost());
+  for (const auto& costKey : heap_) {
+    outCosts.push_back(costKey.first);
+    outKeys.push_back(costKey.second);
+  }
+}
+
+}
+}
+}
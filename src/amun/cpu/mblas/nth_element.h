@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "cpu/mblas/matrix.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Partial top-k selection over the rows of a score matrix. The matrix is scanned
+// once, a SIMD register at a time (see simd.h) against the current k-th best
+// value, and candidates are kept in a small heap. Buffers are reused between calls, so one instance should be
+// owned by each thread (e.g. by its BestHyps).
+class NthElement {
+  public:
+    NthElement() = delete;
+    NthElement(const NthElement &copy) = delete;
+    explicit NthElement(size_t maxBeamSize);
+
+    // Best beamSizes[i] entries of each sentence i, appended best-first. Rows are
+    // grouped by sentence, rowSizes[i] rows for sentence i. Keys index into
+    // Probs.data().
+    void getNBestList(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                      const ArrayMatrix& Probs,
+                      std::vector<float>& outCosts, std::vector<size_t>& outKeys);
+
+    // Same on unnormalised scores: entry (r, c) is ranked and returned as
+    // scale * (Probs(r, c) - logNorms[r]) + costs[r], computed on the fly.
+    void getNBestList(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                      const ArrayMatrix& Probs,
+                      const std::vector<float>& logNorms, float scale,
+                      const std::vector<float>& costs,
+                      std::vector<float>& outCosts, std::vector<size_t>& outKeys);
+
+  private:
+    typedef std::pair<float, size_t> CostKey;
+
+    void Reset(size_t k);
+
+    // offers scale * (data[i] - norm) + bias for i in [0, size), keyed offset + i
+    void Scan(const float* data, size_t size, size_t offset,
+              float norm, float scale, float bias);
+
+    void Flush(std::vector<float>& outCosts, std::vector<size_t>& outKeys);
+
+    size_t k_;
+    std::vector<CostKey> heap_;
+};
+
+}
+}
+}
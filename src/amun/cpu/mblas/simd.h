@@ -0,0 +1,140 @@
+#pragma once
+
+// Thin wrappers around AVX-512 or AVX2/FMA registers for the hand-vectorised
+// kernels of mblas, with vector ports of the approximations in
+// simd_math_prims.h. AMUN_SIMD is left undefined on other targets, where the
+// kernels only use their scalar code.
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#define AMUN_SIMD
+#include <immintrin.h>
+#endif
+
+#include <cstddef>
+
+#include "cpu/mblas/simd_math_prims.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+namespace simd {
+
+#if defined(__AVX512F__)
+struct Simd {
+  typedef __m512 V;
+  static const size_t width = 16;
+
+  static V Load(const float* p) { return _mm512_loadu_ps(p); }
+  static void Store(float* p, V v) { _mm512_storeu_ps(p, v); }
+  static V Set(float f) { return _mm512_set1_ps(f); }
+  static V Add(V a, V b) { return _mm512_add_ps(a, b); }
+  static V Sub(V a, V b) { return _mm512_sub_ps(a, b); }
+  static V Mul(V a, V b) { return _mm512_mul_ps(a, b); }
+  static V Div(V a, V b) { return _mm512_div_ps(a, b); }
+  static V MulAdd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+  static V Min(V a, V b) { return _mm512_min_ps(a, b); }
+  static V Max(V a, V b) { return _mm512_max_ps(a, b); }
+  static V IfEqual(V a, V b, V then, V otherwise) {
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ), otherwise, then);
+  }
+  static bool AnyGreater(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ) != 0; }
+  static float Sum(V a) { return _mm512_reduce_add_ps(a); }
+  static float Max(V a) { return _mm512_reduce_max_ps(a); }
+
+  static V Exp(V x) {
+    V v = MulAdd(Set(12102203.1615614f), x, Set(1065353216.f));
+    v = Max(Min(v, Set(exp_cst1)), Set(exp_cst2));
+    __m512i i = _mm512_cvttps_epi32(v);
+    V xu = _mm512_castsi512_ps(_mm512_and_si512(i, _mm512_set1_epi32(0x7F800000)));
+    V b = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(i, _mm512_set1_epi32(0x7FFFFF)),
+                                              _mm512_set1_epi32(0x3F800000)));
+    return Mul(xu, Poly(b));
+  }
+
+  static V Poly(V b) {
+    V p = MulAdd(b, Set(1.3671023382430374383648148e-2f), Set(-2.88093587581985443087955e-3f));
+    p = MulAdd(b, p, Set(0.168143436463395944830000f));
+    p = MulAdd(b, p, Set(0.310670891004095530771135f));
+    return MulAdd(b, p, Set(0.510397365625862338668154f));
+  }
+};
+#elif defined(__AVX2__) && defined(__FMA__)
+struct Simd {
+  typedef __m256 V;
+  static const size_t width = 8;
+
+  static V Load(const float* p) { return _mm256_loadu_ps(p); }
+  static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+  static V Set(float f) { return _mm256_set1_ps(f); }
+  static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+  static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+  static V MulAdd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+  static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+  static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+  static V IfEqual(V a, V b, V then, V otherwise) {
+    return _mm256_blendv_ps(otherwise, then, _mm256_cmp_ps(a, b, _CMP_EQ_OQ));
+  }
+  static bool AnyGreater(V a, V b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)) != 0;
+  }
+
+  static float Sum(V a) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+  }
+
+  static float Max(V a) {
+    __m128 s = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_max_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+  }
+
+  static V Exp(V x) {
+    V v = MulAdd(Set(12102203.1615614f), x, Set(1065353216.f));
+    v = Max(Min(v, Set(exp_cst1)), Set(exp_cst2));
+    __m256i i = _mm256_cvttps_epi32(v);
+    V xu = _mm256_castsi256_ps(_mm256_and_si256(i, _mm256_set1_epi32(0x7F800000)));
+    V b = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(i, _mm256_set1_epi32(0x7FFFFF)),
+                                              _mm256_set1_epi32(0x3F800000)));
+    return Mul(xu, Poly(b));
+  }
+
+  static V Poly(V b) {
+    V p = MulAdd(b, Set(1.3671023382430374383648148e-2f), Set(-2.88093587581985443087955e-3f));
+    p = MulAdd(b, p, Set(0.168143436463395944830000f));
+    p = MulAdd(b, p, Set(0.310670891004095530771135f));
+    return MulAdd(b, p, Set(0.510397365625862338668154f));
+  }
+};
+#endif
+
+#ifdef AMUN_SIMD
+typedef Simd::V V;
+
+inline V Sigmoid(V x) {
+  V one = Simd::Set(1.0f);
+  return Simd::Div(one, Simd::Add(one, Simd::Exp(Simd::Sub(Simd::Set(0.0f), x))));
+}
+
+// vector port of tanhapprox
+inline V Tanh(V x) {
+  x = Simd::Max(Simd::Min(x, Simd::Set(4.97f)), Simd::Set(-4.97f));
+  V x2 = Simd::Mul(x, x);
+  V a = Simd::MulAdd(x2, Simd::Add(x2, Simd::Set(378.0f)), Simd::Set(17325.0f));
+  a = Simd::Mul(x, Simd::MulAdd(x2, a, Simd::Set(135135.0f)));
+  V b = Simd::MulAdd(x2, Simd::Set(28.0f), Simd::Set(3150.0f));
+  b = Simd::MulAdd(x2, b, Simd::Set(62370.0f));
+  b = Simd::MulAdd(x2, b, Simd::Set(135135.0f));
+  return Simd::Div(a, b);
+}
+#endif
+
+}
+}
+}
+}
@@ -0,0 +1,122 @@
+#include <cmath>
+#include <limits>
+
+#include "cpu/mblas/softmax.h"
+#include "cpu/mblas/simd.h"
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+namespace {
+
+// Maximum of the row and sum of exp(x - max) in a single read, adding and
+// storing the bias on the way. Every lane keeps its own maximum and rescales
+// its sum only when that maximum grows.
+void MaxSumExp(float* x, const float* bias, size_t cols, float& outMax, float& outSum)
+{
+  float max = std::numeric_limits<float>::lowest();
+  float sum = 0.0f;
+  size_t i = 0;
+#ifdef AMUN_SIMD
+  using namespace simd;
+  if (cols >= Simd::width) {
+    V one = Simd::Set(1.0f);
+    V vMax = Simd::Set(max);
+    V vSum = Simd::Set(0.0f);
+    for (; i + Simd::width <= cols; i += Simd::width) {
+      V v = Simd::Load(x + i);
+      if (bias) {
+        v = Simd::Add(v, Simd::Load(bias + i));
+        Simd::Store(x + i, v);
+      }
+      V newMax = Simd::Max(vMax, v);
+      V scale = Simd::IfEqual(vMax, newMax, one, Simd::Exp(Simd::Sub(vMax, newMax)));
+      vSum = Simd::MulAdd(vSum, scale, Simd::Exp(Simd::Sub(v, newMax)));
+      vMax = newMax;
+    }
+
+    float maxs[Simd::width], sums[Simd::width];
+    Simd::Store(maxs, vMax);
+    Simd::Store(sums, vSum);
+    max = Simd::Max(vMax);
+    for (size_t l = 0; l < Simd::width; ++l) {
+      sum += maxs[l] == max ? sums[l] : sums[l] * expapprox(maxs[l] - max);
+    }
+  }
+#endif
+  for (; i < cols; ++i) {
+    float v = bias ? x[i] + bias[i] : x[i];
+    x[i] = v;
+    if (v > max) {
+      sum = sum * expapprox(max - v) + 1.0f;
+      max = v;
+    } else {
+      sum += expapprox(v - max);
+    }
+  }
+
+  outMax = max;
+  outSum = sum;
+}
+
+}
+
+void SoftmaxRows(float* in, size_t stride, size_t rows, size_t cols)
+{
+  for (size_t j = 0; j < rows; ++j) {
+    float* x = in + j * stride;
+    float max, sum;
+    MaxSumExp(x, nullptr, cols, max, sum);
+    float inv = 1.0f / sum;
+
+    size_t i = 0;
+#ifdef AMUN_SIMD
+    using namespace simd;
+    V vMax = Simd::Set(max);
+    V vInv = Simd::Set(inv);
+    for (; i + Simd::width <= cols; i += Simd::width) {
+      Simd::Store(x + i, Simd::Mul(Simd::Exp(Simd::Sub(Simd::Load(x + i), vMax)), vInv));
+    }
+#endif
+    for (; i < cols; ++i) {
+      x[i] = expapprox(x[i] - max) * inv;
+    }
+  }
+}
+
+void LogSoftmaxRows(float* in, size_t stride, size_t rows, size_t cols, const float* bias)
+{
+  for (size_t j = 0; j < rows; ++j) {
+    float* x = in + j * stride;
+    float max, sum;
+    MaxSumExp(x, bias, cols, max, sum);
+    float logNorm = max + std::log(sum);
+
+    size_t i = 0;
+#ifdef AMUN_SIMD
+    using namespace simd;
+    V vLogNorm = Simd::Set(logNorm);
+    for (; i + Simd::width <= cols; i += Simd::width) {
+      Simd::Store(x + i, Simd::Sub(Simd::Load(x + i), vLogNorm));
+    }
+#endif
+    for (; i < cols; ++i) {
+      x[i] -= logNorm;
+    }
+  }
+}
+
+void LogSumExpRows(float* in, size_t stride, size_t rows, size_t cols, const float* bias,
+                   float* logNorms)
+{
+  for (size_t j = 0; j < rows; ++j) {
+    float max, sum;
+    MaxSumExp(in + j * stride, bias, cols, max, sum);
+    logNorms[j] = max + std::log(sum);
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+namespace amunmt {
+namespace CPU {
+namespace mblas {
+
+// Row-wise softmax kernels on `rows` rows of `cols` values, `stride` floats
+// apart. The optional bias (cols values, may be nullptr) is added to every row
+// and stored in the same pass that finds the row maximum and sum of
+// exponentials, so no exponential ever sees a positive argument.
+
+// in = exp(in - max) / sum
+void SoftmaxRows(float* in, size_t stride, size_t rows, size_t cols);
+
+// in = in + bias - logNorm, with logNorm = log(sum(exp(in + bias)))
+void LogSoftmaxRows(float* in, size_t stride, size_t rows, size_t cols, const float* bias);
+
+// in = in + bias and logNorms[j] = log(sum(exp(in + bias))) of row j
+void LogSumExpRows(float* in, size_t stride, size_t rows, size_t cols, const float* bias,
+                   float* logNorms);
+
+}
+}
+}
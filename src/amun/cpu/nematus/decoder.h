@@ -1,6 +1,10 @@
 #pragma once
 
 #include "../mblas/matrix.h"
+#include "../mblas/attention.h"
+#include "../mblas/gates.h"
+#include "../mblas/half.h"
+#include "../mblas/int8.h"
 #include "model.h"
 #include "gru.h"
 #include "transition.h"
@@ -19,23 +23,24 @@ class Decoder {
           : w_(model)
         {}
 
-        void Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) {
+        void Lookup(mblas::Matrix& Rows, std::vector<size_t>& tids,
+                    const std::vector<size_t>& ids) {
           using namespace mblas;
-          std::vector<size_t> tids = ids;
+          tids = ids;
           for (auto&& id : tids) {
-            if (id >= w_.E_.rows()) {
+            if (id >= w_.rows()) {
               id = 1;
             }
           }
-          Rows = Assemble<byRow, Matrix>(w_.E_, tids);
+          w_.Lookup(Rows, tids);
         }
 
         size_t GetCols() {
-          return w_.E_.columns();
+          return w_.columns();
         }
 
         size_t GetRows() const {
-          return w_.E_.rows();
+          return w_.rows();
         }
 
       private:
@@ -46,31 +51,36 @@ class Decoder {
     template <class Weights1, class Weights2>
     class RNNHidden {
       public:
-        RNNHidden(const Weights1& initModel, const Weights2& gruModel)
+        RNNHidden(const Weights1& initModel, const Weights2& gruModel,
+                  const mblas::Matrix& table)
           : w_(initModel),
-            gru_(gruModel)
+            gru_(gruModel),
+            table_(table)
         {}
 
         void InitializeState(
           mblas::Matrix& State,
           const mblas::Matrix& SourceContext,
-          const size_t batchSize = 1)
+          const std::vector<size_t>& sourceLengths)
         {
           using namespace mblas;
 
-          // Calculate mean of source context, rowwise
-          // Repeat mean batchSize times by broadcasting
-          Temp1_ = Mean<byRow, Matrix>(SourceContext);
-
-          Temp2_.resize(batchSize, SourceContext.columns());
-          Temp2_ = 0.0f;
-          AddBiasVector<byRow>(Temp2_, Temp1_);
-
-          State = Temp2_ * w_.Wi_;
-          AddBiasVector<byRow>(State, w_.Bi_);
+          // Calculate mean of each source context, rowwise,
+          // ignoring the padding of shorter sentences
+          size_t batchSize = sourceLengths.size();
+          size_t maxLength = SourceContext.rows() / batchSize;
+          Reserve(Temp2_, batchSize, SourceContext.columns());
+          for (size_t i = 0; i < batchSize; ++i) {
+            Mean<byRow>(Temp1_, blaze::submatrix(SourceContext, i * maxLength, 0,
+                                                 sourceLengths[i], SourceContext.columns()));
+            blaze::row(Temp2_, i) = blaze::row(Temp1_, 0);
+          }
 
+          Multiply(State, Temp2_, w_.Wi_);
           if (w_.lns_.rows()) {
-            LayerNormalization(State, w_.lns_, w_.lnb_);
+            AddBiasLayerNormalization(State, w_.Bi_, w_.lns_, w_.lnb_);
+          } else {
+            AddBiasVector<byRow>(State, w_.Bi_);
           }
           State = blaze::forEach(State, Tanh());
           // std::cerr << "INIT: " << std::endl;
@@ -78,15 +88,28 @@ class Decoder {
           // std::cerr << std::endl;
         }
 
+        // words[i] is the word embedded in row i of Context, see Weights::DecTables
         void GetNextState(mblas::Matrix& NextState,
                           const mblas::Matrix& State,
-                          const mblas::Matrix& Context) {
-          gru_.GetNextState(NextState, State, Context);
+                          const mblas::Matrix& Context,
+                          const std::vector<size_t>& words) {
+          if (words.empty() || !table_.rows()) {
+            gru_.GetNextState(NextState, State, Context);
+            return;
+          }
+          mblas::ProjectWords(RUH_, Context, words, table_,
+                              [this](mblas::Matrix& RUH, const mblas::Matrix& Context) {
+                                gru_.GetInputProjection(RUH, Context);
+                              });
+          gru_.GetNextState(NextState, State, RUH_, 0);
         }
 
       private:
         const Weights1& w_;
         const GRU<Weights2> gru_;
+        const mblas::Matrix& table_;
+
+        mblas::Matrix RUH_;
 
         mblas::Matrix Temp1_;
         mblas::Matrix Temp2_;
@@ -124,46 +147,65 @@ class Decoder {
       public:
         Attention(const Weights& model)
           : w_(model)
-        {
-          V_ = blaze::trans(blaze::row(w_.V_, 0));
-        }
+        {}
 
         void Init(const mblas::Matrix& SourceContext) {
           using namespace mblas;
-          SCU_ = SourceContext * w_.U_;
-          mblas::AddBiasVector<mblas::byRow>(SCU_, w_.B_);
-
+          Multiply(SCU_, SourceContext, w_.U_);
           if (w_.Wc_att_lns_.rows()) {
-            LayerNormalization(SCU_, w_.Wc_att_lns_, w_.Wc_att_lnb_);
+            AddBiasLayerNormalization(SCU_, w_.B_, w_.Wc_att_lns_, w_.Wc_att_lnb_);
+          } else {
+            AddBiasVector<byRow>(SCU_, w_.B_);
           }
         }
 
         void GetAlignedSourceContext(
           mblas::Matrix& AlignedSourceContext,
           const mblas::Matrix& HiddenState,
-          const mblas::Matrix& SourceContext)
+          const mblas::Matrix& SourceContext,
+          const std::vector<size_t>& sourceLengths,
+          const std::vector<uint>& beamSizes)
         {
           using namespace mblas;
 
-          Temp2_ = HiddenState * w_.W_;
+          Multiply(Temp2_, HiddenState, w_.W_);
           if (w_.W_comb_lns_.rows()) {
             LayerNormalization(Temp2_, w_.W_comb_lns_, w_.W_comb_lnb_);
           }
 
-          Temp1_ = Broadcast<Matrix>(Tanh(), SCU_, Temp2_);
+          // rows of HiddenState are grouped by sentence, beamSizes[i] rows for sentence i.
+          // Positions past the end of a sentence keep a zero weight.
+          size_t maxLength = SourceContext.rows() / sourceLengths.size();
+          Reserve(A_, HiddenState.rows(), maxLength);
+          A_ = 0.0f;
+          Reserve(AlignedSourceContext, HiddenState.rows(), SourceContext.columns());
+
+          size_t offset = 0;
+          for (size_t i = 0; i < beamSizes.size(); ++i) {
+            size_t beamSize = beamSizes[i];
+            if (beamSize == 0) {
+              continue;
+            }
+            size_t words = sourceLengths[i];
 
-          A_.resize(Temp1_.rows(), 1);
-          blaze::column(A_, 0) = Temp1_ * V_;
-          size_t words = SourceContext.rows();
-          // batch size, for batching, divide by numer of sentences
-          size_t batchSize = HiddenState.rows();
-          Reshape(A_, batchSize, words); // due to broadcasting above
+            auto A = blaze::submatrix(A_, offset, 0, beamSize, words);
+            mblas::AttentionScores(A_.data(offset), A_.spacing(),
+                                   SCU_.data(i * maxLength), SCU_.spacing(), words,
+                                   Temp2_.data(offset), Temp2_.spacing(), beamSize,
+                                   w_.V_.data(), w_.V_.columns());
 
-          float bias = w_.C_(0,0);
-          blaze::forEach(A_, [=](float x) { return x + bias; });
+            // the scalar bias w_.C_ cancels out in the softmax
+            mblas::SafeSoftmax(A);
+            blaze::submatrix(AlignedSourceContext, offset, 0, beamSize, SourceContext.columns())
+              = A * blaze::submatrix(SourceContext, i * maxLength, 0, words, SourceContext.columns());
 
-          mblas::SafeSoftmax(A_);
-          AlignedSourceContext = A_ * SourceContext;
+            offset += beamSize;
+          }
+        }
+
+        void CompactSource(const std::vector<size_t>& keep,
+                           size_t maxLength, size_t newMaxLength) {
+          mblas::CompactRowBlocks(SCU_, keep, maxLength, newMaxLength);
         }
 
         void GetAttention(mblas::Matrix& Attention) {
@@ -178,83 +220,171 @@ class Decoder {
         const Weights& w_;
 
         mblas::Matrix SCU_;
-        mblas::Matrix Temp1_;
         mblas::Matrix Temp2_;
         mblas::Matrix A_;
-        mblas::ColumnVector V_;
     };
 
     //////////////////////////////////////////////////////////////
     template <class Weights>
     class Softmax {
       public:
-        Softmax(const Weights& model)
+        // Evaluates the readout as one GEMM and multiplies by the int8 copy of
+        // W4 once the loader has made them, see Weights::FuseReadout and
+        // Weights::ToInt8.
+        Softmax(const Weights& model, const mblas::Matrix& table)
         : w_(model),
-          filtered_(false)
+          table_(table),
+          filtered_(false),
+          normalize_(true),
+          fused_(w_.W123_.rows()),
+          int8_(w_.W48_.rows())
         {}
 
         void GetProbs(mblas::ArrayMatrix& Probs,
                   const mblas::Matrix& State,
                   const mblas::Matrix& Embedding,
+                  const std::vector<size_t>& words,
                   const mblas::Matrix& AlignedSourceContext) {
           using namespace mblas;
 
-          T1_ = State * w_.W1_;
-          AddBiasVector<byRow>(T1_, w_.B1_);
+          if (fused_) {
+            const size_t rows = State.rows();
+            const size_t cols1 = State.columns();
+            const size_t cols2 = Embedding.columns();
+            Reserve(Input_, rows, w_.W123_.rows());
+            blaze::submatrix(Input_, 0, 0, rows, cols1) = State;
+            blaze::submatrix(Input_, 0, cols1, rows, cols2) = Embedding;
+            blaze::submatrix(Input_, 0, cols1 + cols2, rows, AlignedSourceContext.columns())
+              = AlignedSourceContext;
+
+            Multiply(T1_, Input_, w_.W123_);
+            for (size_t j = 0; j < rows; ++j) {
+              AddBiasTanh(T1_.data(j), w_.B123_.data(), T1_.columns());
+            }
+            GetLogits(Probs, T1_);
+            return;
+          }
+
+          Multiply(T1_, State, w_.W1_);
           if (w_.lns_1_.rows()) {
-            LayerNormalization(T1_, w_.lns_1_, w_.lnb_1_);
+            AddBiasLayerNormalization(T1_, w_.B1_, w_.lns_1_, w_.lnb_1_);
+          } else {
+            AddBiasVector<byRow>(T1_, w_.B1_);
           }
           // std::cerr << "State" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << T1_(0, i) << " ";
           // std::cerr << std::endl;
 
-          T2_ = Embedding * w_.W2_;
-          AddBiasVector<byRow>(T2_, w_.B2_);
-          if (w_.lns_2_.rows()) {
-            LayerNormalization(T2_, w_.lns_2_, w_.lnb_2_);
+          if (words.empty() || !table_.rows()) {
+            GetEmbeddingProjection(T2_, Embedding);
+          } else {
+            ProjectWords(T2_, Embedding, words, table_,
+                         [this](Matrix& T2, const Matrix& Embedding) {
+                           GetEmbeddingProjection(T2, Embedding);
+                         });
           }
           // std::cerr << "emb" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << T2_(0, i) << " ";
           // std::cerr << std::endl;
 
-          T3_ = AlignedSourceContext * w_.W3_;
-          AddBiasVector<byRow>(T3_, w_.B3_);
+          Multiply(T3_, AlignedSourceContext, w_.W3_);
           if (w_.lns_3_.rows()) {
-            LayerNormalization(T3_, w_.lns_3_, w_.lnb_3_);
+            AddBiasLayerNormalization(T3_, w_.B3_, w_.lns_3_, w_.lnb_3_);
+          } else {
+            AddBiasVector<byRow>(T3_, w_.B3_);
           }
           // std::cerr << "CTX" << std::endl;
           // for(int i = 0; i < 5; ++i) std::cerr << T3_(0, i) << " ";
           // std::cerr << std::endl;
 
-          auto t = blaze::forEach(T1_ + T2_ + T3_, Tanh());
-
-          if(!filtered_) {
-            Probs = t * w_.W4_;
-            AddBiasVector<byRow>(Probs, w_.B4_);
-          } else {
-            Probs = t * FilteredW4_;
-            AddBiasVector<byRow>(Probs, FilteredB4_);
+          T1_ += T3_;
+          for (size_t j = 0; j < T1_.rows(); ++j) {
+            AddBiasTanh(T1_.data(j), T2_.data(j), T1_.columns());
           }
-          // std::cerr << "LOgit" << std::endl;
-          // for(int i = 0; i < 5; ++i) std::cerr << Probs(0, i) << " ";
-          // std::cerr << std::endl;
-          LogSoftmax(Probs);
+          GetLogits(Probs, T1_);
+        }
+
+        // When disabled, GetProbs leaves the logits in Probs and only computes
+        // their per-row log-partition (see GetLogNorms). The caller then has to
+        // normalise the entries it actually uses.
+        void SetNormalize(bool normalize) {
+          normalize_ = normalize;
+          logNorms_.clear();
+        }
+
+        const std::vector<float>& GetLogNorms() const {
+          return logNorms_;
         }
 
         void Filter(const std::vector<size_t>& ids) {
           filtered_ = true;
           using namespace mblas;
-          FilteredW4_ = Assemble<byColumn, Matrix>(w_.W4_, ids);
-          FilteredB4_ = Assemble<byColumn, Matrix>(w_.B4_, ids);
+          if (int8_) {
+            AssembleColumns(FilteredW48_, w_.W48_, ids);
+          } else if (w_.W4Half_.rows()) {
+            AssembleColumns(FilteredW4_, w_.W4Half_, ids);
+          } else {
+            Assemble<byColumn>(FilteredW4_, w_.W4_, ids);
+          }
+          Assemble<byColumn>(FilteredB4_, w_.B4_, ids);
         }
 
       private:
+        // T2 = Embedding * W2 + B2, normalised if the model says so
+        void GetEmbeddingProjection(mblas::Matrix& T2, const mblas::Matrix& Embedding) const {
+          using namespace mblas;
+          Multiply(T2, Embedding, w_.W2_);
+          if (w_.lns_2_.rows()) {
+            AddBiasLayerNormalization(T2, w_.B2_, w_.lns_2_, w_.lnb_2_);
+          } else {
+            AddBiasVector<byRow>(T2, w_.B2_);
+          }
+        }
+
+        // Probs = log-softmax of t * W4 + B4, or only its log-partition
+        void GetLogits(mblas::ArrayMatrix& Probs, const mblas::Matrix& t) {
+          using namespace mblas;
+          if (int8_) {
+            Multiply(Probs, t, filtered_ ? FilteredW48_ : w_.W48_);
+          } else if (filtered_) {
+            Multiply(Probs, t, FilteredW4_);
+          } else if (w_.W4Half_.rows()) {
+            Multiply(Probs, t, w_.W4Half_);
+          } else {
+            Multiply(Probs, t, w_.W4_);
+          }
+          if (filtered_) {
+            AddOutputBias(Probs, FilteredB4_);
+          } else {
+            AddOutputBias(Probs, w_.B4_);
+          }
+        }
+
+        template <class BT>
+        void AddOutputBias(mblas::ArrayMatrix& Probs, const BT& B4) {
+          if (normalize_) {
+            mblas::AddBiasLogSoftmax(Probs, B4);
+          } else {
+            mblas::AddBiasLogSumExp(Probs, B4, logNorms_);
+          }
+        }
+
         const Weights& w_;
+        const mblas::Matrix& table_;
         bool filtered_;
+        bool normalize_;
+        bool fused_;
+        bool int8_;
+        std::vector<float> logNorms_;
+
+        mblas::Matrix Input_;
 
         mblas::Matrix FilteredW4_;
         mblas::Matrix FilteredB4_;
 
+        // per batch, for the filtered vocabulary
+        mblas::Int8Matrix FilteredW48_;
+
         mblas::Matrix T1_;
         mblas::Matrix T2_;
         mblas::Matrix T3_;
@@ -263,24 +393,28 @@ class Decoder {
   public:
     Decoder(const Weights& model)
     : embeddings_(model.decEmbeddings_),
-      rnn1_(model.decInit_, model.decGru1_),
+      rnn1_(model.decInit_, model.decGru1_, model.decTables_.GRU_),
       rnn2_(model.decGru2_, model.decTransition_),
       attention_(model.decAttention_),
-      softmax_(model.decSoftmax_)
+      softmax_(model.decSoftmax_, model.decTables_.Readout_)
     {}
 
     void Decode(
       mblas::Matrix& NextState,
       const mblas::Matrix& State,
       const mblas::Matrix& Embeddings,
-      const mblas::Matrix& SourceContext)
+      const std::vector<size_t>& words,
+      const mblas::Matrix& SourceContext,
+      const std::vector<size_t>& sourceLengths,
+      const std::vector<uint>& beamSizes)
     {
-      GetHiddenState(HiddenState_, State, Embeddings);
+      GetHiddenState(HiddenState_, State, Embeddings, words);
       // std::cerr << "HIDDEN: " << std::endl;
       // for (int i = 0; i < 5; ++i) std::cerr << HiddenState_(0, i) << " ";
       // std::cerr << std::endl;
 
-      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext);
+      GetAlignedSourceContext(AlignedSourceContext_, HiddenState_, SourceContext,
+                              sourceLengths, beamSizes);
       // std::cerr << "ALIGNED SRC: " << std::endl;
       // for (int i = 0; i < 5; ++i) std::cerr << AlignedSourceContext_(0, i) << " ";
       // std::cerr << std::endl;
@@ -290,7 +424,7 @@ class Decoder {
       // for (int i = 0; i < 5; ++i) std::cerr << NextState(0, i) << " ";
       // std::cerr << std::endl;
 
-      GetProbs(NextState, Embeddings, AlignedSourceContext_);
+      GetProbs(NextState, Embeddings, words, AlignedSourceContext_);
     }
 
     mblas::ArrayMatrix& GetProbs() {
@@ -299,26 +433,40 @@ class Decoder {
 
     void EmptyState(mblas::Matrix& State,
                     const mblas::Matrix& SourceContext,
-                    size_t batchSize = 1) {
-    	rnn1_.InitializeState(State, SourceContext, batchSize);
+                    const std::vector<size_t>& sourceLengths) {
+    	rnn1_.InitializeState(State, SourceContext, sourceLengths);
     	attention_.Init(SourceContext);
     }
 
     void EmptyEmbedding(mblas::Matrix& Embedding,
                         size_t batchSize = 1) {
-      Embedding.resize(batchSize, embeddings_.GetCols());
+      mblas::Reserve(Embedding, batchSize, embeddings_.GetCols());
       Embedding = 0.0f;
     }
 
     void Lookup(mblas::Matrix& Embedding,
+                std::vector<size_t>& words,
                 const std::vector<size_t>& w) {
-      embeddings_.Lookup(Embedding, w);
+      embeddings_.Lookup(Embedding, words, w);
     }
 
     void Filter(const std::vector<size_t>& ids) {
       softmax_.Filter(ids);
     }
 
+    void SetNormalizeProbs(bool normalize) {
+      softmax_.SetNormalize(normalize);
+    }
+
+    const std::vector<float>& GetLogNorms() const {
+      return softmax_.GetLogNorms();
+    }
+
+    void CompactSource(const std::vector<size_t>& keep,
+                       size_t maxLength, size_t newMaxLength) {
+      attention_.CompactSource(keep, maxLength, newMaxLength);
+    }
+
     void GetAttention(mblas::Matrix& attention) {
     	attention_.GetAttention(attention);
     }
@@ -335,14 +483,18 @@ class Decoder {
 
     void GetHiddenState(mblas::Matrix& HiddenState,
                         const mblas::Matrix& PrevState,
-                        const mblas::Matrix& Embedding) {
-      rnn1_.GetNextState(HiddenState, PrevState, Embedding);
+                        const mblas::Matrix& Embedding,
+                        const std::vector<size_t>& words) {
+      rnn1_.GetNextState(HiddenState, PrevState, Embedding, words);
     }
 
     void GetAlignedSourceContext(mblas::Matrix& AlignedSourceContext,
                                  const mblas::Matrix& HiddenState,
-                                 const mblas::Matrix& SourceContext) {
-    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext);
+                                 const mblas::Matrix& SourceContext,
+                                 const std::vector<size_t>& sourceLengths,
+                                 const std::vector<uint>& beamSizes) {
+    	attention_.GetAlignedSourceContext(AlignedSourceContext, HiddenState, SourceContext,
+    	                                   sourceLengths, beamSizes);
     }
 
     void GetNextState(mblas::Matrix& State,
@@ -354,8 +506,9 @@ class Decoder {
 
     void GetProbs(const mblas::Matrix& State,
                   const mblas::Matrix& Embedding,
+                  const std::vector<size_t>& words,
                   const mblas::Matrix& AlignedSourceContext) {
-      softmax_.GetProbs(Probs_, State, Embedding, AlignedSourceContext);
+      softmax_.GetProbs(Probs_, State, Embedding, words, AlignedSourceContext);
     }
 
   private:
@@ -1,29 +1,44 @@
 #include "encoder.h"
 
+#include "common/sentences.h"
+
 using namespace std;
 
 namespace amunmt {
 namespace CPU {
 namespace Nematus {
 
-void Encoder::GetContext(const std::vector<size_t>& words, mblas::Matrix& context) {
-  std::vector<mblas::Matrix> embeddedWords;
+void Encoder::GetContext(const Sentences& source, size_t tab, mblas::Matrix& context,
+                         std::vector<size_t>& sourceLengths) {
+  size_t maxLength = 0;
+  sourceLengths.resize(source.size());
+  for (size_t i = 0; i < source.size(); ++i) {
+    sourceLengths[i] = source.at(i)->GetWords(tab).size();
+    maxLength = std::max(maxLength, sourceLengths[i]);
+  }
 
-  context.resize(words.size(),
+  context.resize(source.size() * maxLength,
                  forwardRnn_.GetStateLength() + backwardRnn_.GetStateLength());
 
-  for (auto& w : words) {
-    embeddedWords.emplace_back();
-    mblas::Matrix &embed = embeddedWords.back();
-    embeddings_.Lookup(embed, w);
+  // all words in one matrix, position by position, shorter sentences are padded with EOS
+  words_.resize(maxLength * source.size());
+  for (size_t pos = 0; pos < maxLength; ++pos) {
+    for (size_t i = 0; i < source.size(); ++i) {
+      const Words& sentence = source.at(i)->GetWords(tab);
+      words_[pos * source.size() + i] = (pos < sentence.size()) ? sentence[pos] : EOS_ID;
+    }
+  }
+  embeddings_.Lookup(embedded_, words_);
+
+  // the directions only share the embeddings and fill disjoint halves of context
+  auto forward = [&] { forwardRnn_.GetContext(embedded_, context, sourceLengths, false); };
+  auto backward = [&] { backwardRnn_.GetContext(embedded_, context, sourceLengths, true); };
+  if (forkJoin_) {
+    forkJoin_->Run(backward, forward);
+  } else {
+    forward();
+    backward();
   }
-
-  forwardRnn_.GetContext(embeddedWords.cbegin(),
-						 embeddedWords.cend(),
-						 context, false);
-  backwardRnn_.GetContext(embeddedWords.crbegin(),
-						  embeddedWords.crend(),
-						  context, true);
 }
 
 }  // namespace Nematus
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <memory>
+
 #include "../mblas/matrix.h"
+#include "common/fork_join.h"
 #include "model.h"
 #include "gru.h"
 #include "transition.h"
 
 namespace amunmt {
+
+class Sentences;
+
 namespace CPU {
 namespace Nematus {
 
@@ -20,12 +26,15 @@ class Encoder {
         : w_(model)
         {}
 
-        void Lookup(mblas::Matrix& Row, size_t i) {
-		  size_t len = w_.E_.columns();
-          if(i < w_.E_.rows())
-            Row = blaze::submatrix(w_.E_, i, 0, 1, len);
-          else
-            Row = blaze::submatrix(w_.E_, 1, 0, 1, len); // UNK
+        void Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) {
+          using namespace mblas;
+          std::vector<size_t> tids = ids;
+          for (auto&& id : tids) {
+            if (id >= w_.rows()) {
+              id = 1; // UNK
+            }
+          }
+          w_.Lookup(Rows, tids);
         }
 
         const Weights& w_;
@@ -46,34 +55,32 @@ class Encoder {
           State_ = 0.0f;
         }
 
-        void GetNextState(mblas::Matrix& nextState,
-                          const mblas::Matrix& state,
-                          const mblas::Matrix& embd) {
-          gru_.GetNextState(nextState, state, embd);
-          // std::cerr << "GRU: " << std::endl;
-          // for (int i = 0; i < 10; ++i) std::cerr << nextState(0, i) << " ";
-          // std::cerr << std::endl;
-          transition_.GetNextState(nextState);
-          // std::cerr << "TRANS: " << std::endl;
-          // for (int i = 0; i < 10; ++i) std::cerr << nextState(0, i) << " ";
-          // std::cerr << std::endl;
-        }
-
-        template <class It>
-        void GetContext(It it, It end, mblas::Matrix& Context, bool invert) {
-          InitializeState();
+        // embedded holds the words of all sentences position by position,
+        // batchSize rows per position
+        void GetContext(const mblas::Matrix& embedded, mblas::Matrix& Context,
+                        const std::vector<size_t>& sourceLengths, bool invert) {
+          size_t batchSize = sourceLengths.size();
+          InitializeState(batchSize);
 
-          size_t n = std::distance(it, end);
-          size_t i = 0;
-          while(it != end) {
-          GetNextState(State_, State_, *it++);
+          // input projections of all positions at once, only the recurrent
+          // part has to be computed step by step
+          gru_.GetInputProjection(Inputs_, embedded);
 
+          size_t n = embedded.rows() / batchSize;
           size_t len = gru_.GetStateLength();
-            if(invert)
-              blaze::submatrix(Context, n - i - 1, len, 1, len) = State_;
-            else
-      			  blaze::submatrix(Context, i, 0, 1, len) = State_;
-            ++i;
+          for (size_t i = 0; i < n; ++i) {
+            size_t pos = invert ? n - i - 1 : i;
+            gru_.GetNextState(State_, State_, Inputs_, pos * batchSize);
+            transition_.GetNextState(State_);
+
+            for (size_t j = 0; j < batchSize; ++j) {
+              if (invert && pos >= sourceLengths[j]) {
+                // padding, the backward pass has to start at the last real word
+                blaze::row(State_, j) = 0.0f;
+              }
+              blaze::submatrix(Context, j * n + pos, invert ? len : 0, 1, len)
+                = blaze::submatrix(State_, j, 0, 1, len);
+            }
           }
         }
 
@@ -87,23 +94,30 @@ class Encoder {
         const Transition transition_;
 
         mblas::Matrix State_;
+        mblas::Matrix Inputs_;
     };
 
   /////////////////////////////////////////////////////////////////
   public:
-    Encoder(const Weights& model)
+    // with parallel set, the two directions run concurrently on two cores
+    Encoder(const Weights& model, bool parallel = false)
       : embeddings_(model.encEmbeddings_),
         forwardRnn_(model.encForwardGRU_, model.encForwardTransition_),
-        backwardRnn_(model.encBackwardGRU_, model.encBackwardTransition_)
+        backwardRnn_(model.encBackwardGRU_, model.encBackwardTransition_),
+        forkJoin_(parallel ? new ForkJoin() : nullptr)
     {}
 
-    void GetContext(const std::vector<size_t>& words,
-                    mblas::Matrix& context);
+    void GetContext(const Sentences& source, size_t tab, mblas::Matrix& context,
+                    std::vector<size_t>& sourceLengths);
 
   private:
+    mblas::Matrix embedded_;
+    std::vector<size_t> words_;
+
     Embeddings<Weights::Embeddings> embeddings_;
     EncoderRNN<Weights::GRU, Weights::Transition> forwardRnn_;
     EncoderRNN<Weights::GRU, Weights::Transition> backwardRnn_;
+    std::unique_ptr<ForkJoin> forkJoin_;
 };
 
 }
@@ -24,30 +24,36 @@ EncoderDecoder::EncoderDecoder(const God &god,
                                const Nematus::Weights& model)
   : CPUEncoderDecoderBase(god, name, config, tab),
     model_(model),
-    encoder_(new CPU::Nematus::Encoder(model_)),
+    encoder_(new CPU::Nematus::Encoder(model_, god.Get<bool>("parallel-encoder"))),
     decoder_(new CPU::Nematus::Decoder(model_))
-{}
+{
+  // a lone scorer's probabilities are normalised by BestHyps on the selected entries only
+  decoder_->SetNormalizeProbs(god.GetScorerWeights().size() > 1);
+}
 
 
-void EncoderDecoder::Decode(const State& in, State& out, const std::vector<uint>&) {
+void EncoderDecoder::Decode(const State& in, State& out, const std::vector<uint>& beamSizes) {
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
+  const std::vector<uint>& activeBeamSizes = CompactBatch(beamSizes);
   decoder_->Decode(edOut.GetStates(), edIn.GetStates(),
-                   edIn.GetEmbeddings(), SourceContext_);
+                   edIn.GetEmbeddings(), edIn.GetWords(), SourceContext_,
+                   activeLengths_, activeBeamSizes);
 }
 
 
 void EncoderDecoder::BeginSentenceState(State& state, size_t batchSize) {
   EDState& edState = state.get<EDState>();
-  decoder_->EmptyState(edState.GetStates(), SourceContext_, batchSize);
+  decoder_->EmptyState(edState.GetStates(), SourceContext_, sourceLengths_);
   decoder_->EmptyEmbedding(edState.GetEmbeddings(), batchSize);
+  edState.GetWords().clear();
 }
 
 
 void EncoderDecoder::Encode(const Sentences& sources) {
-  encoder_->GetContext(sources.at(0)->GetWords(tab_),
-                        SourceContext_);
+  encoder_->GetContext(sources, tab_, SourceContext_, sourceLengths_);
+  InitBatch();
 }
 
 
@@ -64,8 +70,25 @@ void EncoderDecoder::AssembleBeamState(const State& in,
   const EDState& edIn = in.get<EDState>();
   EDState& edOut = out.get<EDState>();
 
-  edOut.GetStates() = mblas::Assemble<mblas::byRow, mblas::Matrix>(edIn.GetStates(), beamStateIds);
-  decoder_->Lookup(edOut.GetEmbeddings(), beamWords);
+  mblas::Assemble<mblas::byRow>(edOut.GetStates(), edIn.GetStates(), beamStateIds);
+  decoder_->Lookup(edOut.GetEmbeddings(), edOut.GetWords(), beamWords);
+}
+
+
+void EncoderDecoder::AssembleGreedyState(State& in,
+                                         const std::vector<size_t>& rows,
+                                         const Words& words,
+                                         State& out) {
+  EDState& edIn = in.get<EDState>();
+  EDState& edOut = out.get<EDState>();
+
+  // every sentence is still alive: keep the rows where they are
+  if (rows.size() == edIn.GetStates().rows()) {
+    edOut.GetStates().swap(edIn.GetStates());
+  } else {
+    mblas::Assemble<mblas::byRow>(edOut.GetStates(), edIn.GetStates(), rows);
+  }
+  decoder_->Lookup(edOut.GetEmbeddings(), edOut.GetWords(), words);
 }
 
 
@@ -89,10 +112,20 @@ void EncoderDecoder::Filter(const std::vector<size_t>& filterIds) {
 }
 
 
+void EncoderDecoder::CompactSource(const std::vector<size_t>& keep,
+                                   size_t maxLength, size_t newMaxLength) {
+  decoder_->CompactSource(keep, maxLength, newMaxLength);
+}
+
+
 BaseMatrix& EncoderDecoder::GetProbs() {
   return decoder_->GetProbs();
 }
 
+const std::vector<float>& EncoderDecoder::GetLogNorms() const {
+  return decoder_->GetLogNorms();
+}
+
 }
 }
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "cpu/mblas/matrix.h"
+#include "cpu/mblas/gates.h"
+#include "cpu/mblas/int8.h"
 #include <iomanip>
 
 namespace amunmt {
@@ -8,119 +10,85 @@ namespace CPU {
 template <class Weights>
 class GRU {
   public:
+    // Models without layer normalisation multiply by the int8 copies of
+    // WWx_ and UUx_ once the loader has made them, see Weights::ToInt8.
     GRU(const Weights& model)
       : w_(model),
-        layerNormalization_(w_.W_lns_.rows())
-    {
-      if (!layerNormalization_) {
-        WWx_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(w_.W_, w_.Wx_);
-        UUx_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(w_.U_, w_.Ux_);
-      }
-    }
+        layerNormalization_(w_.W_lns_.rows()),
+        int8_(w_.WWx8_.rows())
+    {}
 
     void GetNextState(
       mblas::Matrix& nextState,
       const mblas::Matrix& state,
       const mblas::Matrix& context) const
     {
-      // std::cerr << "Get next state" << std::endl;
-      if (layerNormalization_) {
-        RUH_1_ = context * w_.W_;
-        mblas::AddBiasVector<mblas::byRow>(RUH_1_, w_.B_);
-        LayerNormalization(RUH_1_, w_.W_lns_, w_.W_lnb_);
-
-        RUH_2_ = context * w_.Wx_;
-        mblas::AddBiasVector<mblas::byRow>(RUH_2_, w_.Bx1_);
-        LayerNormalization(RUH_2_, w_.Wx_lns_, w_.Wx_lnb_);
-
-        RUH_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(RUH_1_, RUH_2_);
-
-        Temp_1_ = state * w_.U_;
-        mblas::AddBiasVector<mblas::byRow>(Temp_1_, w_.Bx3_);
-        LayerNormalization(Temp_1_, w_.U_lns_, w_.U_lnb_);
-
-        Temp_2_ = state * w_.Ux_;
-        mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx2_);
-        LayerNormalization(Temp_2_, w_.Ux_lns_, w_.Ux_lnb_);
+      GetInputProjection(RUH_, context);
+      GetNextState(nextState, state, RUH_, 0);
+    }
 
-        Temp_ = mblas::Concat<mblas::byColumn, mblas::Matrix>(Temp_1_, Temp_2_);
+    // Input side of the update for every row of context, so that a whole
+    // sentence can be projected with one GEMM ahead of the recurrence.
+    void GetInputProjection(mblas::Matrix& ruh, const mblas::Matrix& context) const {
+      if (layerNormalization_) {
+        mblas::Multiply(RUH_1_, context, w_.W_);
+        AddBiasLayerNormalization(RUH_1_, w_.B_, w_.W_lns_, w_.W_lnb_);
 
-        ElementwiseOpsLayerNorm(nextState, state);
+        mblas::Multiply(RUH_2_, context, w_.Wx_);
+        AddBiasLayerNormalization(RUH_2_, w_.Bx1_, w_.Wx_lns_, w_.Wx_lnb_);
 
+        mblas::Concat<mblas::byColumn>(ruh, RUH_1_, RUH_2_);
       } else {
-        RUH_ = context * WWx_;
-        Temp_ = state * UUx_;
-        ElementwiseOps(nextState, state);
+        if (int8_) {
+          mblas::Multiply(ruh, context, w_.WWx8_);
+        } else {
+          mblas::Multiply(ruh, context, w_.WWx_);
+        }
+        mblas::AddBiasVector<mblas::byRow>(ruh, w_.BBx1_);
       }
     }
 
-    void ElementwiseOps(mblas::Matrix& NextState, const mblas::Matrix& State) const {
-      using namespace mblas;
-      using namespace blaze;
-
-      const int rowNo = State.rows();
-      const int colNo = State.columns();
-      NextState.resize(rowNo, colNo);
-
-      for (int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for (int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + w_.B_(0, i) + rowT[i]));
-          float r = 1.0f / (1.0f + ev1);
+    // Same update with the input projection taken from rows
+    // [firstRow, firstRow + state.rows()) of ruh, see GetInputProjection.
+    void GetNextState(
+      mblas::Matrix& nextState,
+      const mblas::Matrix& state,
+      const mblas::Matrix& ruh,
+      size_t firstRow) const
+    {
+      if (layerNormalization_) {
+        mblas::Multiply(Temp_1_, state, w_.U_);
+        AddBiasLayerNormalization(Temp_1_, w_.Bx3_, w_.U_lns_, w_.U_lnb_);
 
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + w_.B_(0, k) + rowT[k]));
-          float u = 1.0f / (1.0f + ev2);
+        mblas::Multiply(Temp_2_, state, w_.Ux_);
+        AddBiasLayerNormalization(Temp_2_, w_.Bx2_, w_.Ux_lns_, w_.Ux_lnb_);
+        mblas::AddBiasVector<mblas::byRow>(Temp_2_, w_.Bx2_);
 
-          float hv = rowH[i] + w_.Bx1_(0, i);
-          float t2v = rowT2[i];
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0f - u) * hv + u * rowState[i];
-        }
+        mblas::Concat<mblas::byColumn>(Temp_, Temp_1_, Temp_2_);
+      } else if (int8_) {
+        mblas::Multiply(Temp_, state, w_.UUx8_);
+      } else {
+        mblas::Multiply(Temp_, state, w_.UUx_);
       }
+      ElementwiseOps(nextState, state, ruh, firstRow);
     }
 
-    void ElementwiseOpsLayerNorm(mblas::Matrix& NextState, const mblas::Matrix& State) const {
-      using namespace mblas;
-      using namespace blaze;
-
-      const int rowNo = State.rows();
-      const int colNo = State.columns();
-      NextState.resize(rowNo, colNo);
-
-      for (int j = 0; j < rowNo; ++j) {
-        auto rowOut = row(NextState, j);
-        auto rowState = row(State, j);
-
-        auto rowRuh = row(RUH_, j);
-        auto rowT   = row(Temp_, j);
-
-        auto rowH   = subvector(rowRuh, 2 * colNo, colNo);
-        auto rowT2  = subvector(rowT, 2 * colNo, colNo);
-
-        for (int i = 0; i < colNo; ++i) {
-          float ev1 = expapprox(-(rowRuh[i] + rowT[i]));
-          float r = 1.0f / (1.0f + ev1);
-
-          int k = i + colNo;
-          float ev2 = expapprox(-(rowRuh[k] + rowT[k]));
-          float u = 1.0f / (1.0f + ev2);
-
-          float hv = rowH[i];
-          float t2v = rowT2[i] + w_.Bx2_(0, i);
-          hv = tanhapprox(hv + r * t2v);
-          rowOut[i] = (1.0f - u) * hv + u * rowState[i];
-        }
+    // biases are already added to ruh and Temp_
+    void ElementwiseOps(mblas::Matrix& NextState, const mblas::Matrix& State,
+                        const mblas::Matrix& RUH, size_t firstRow) const {
+      const size_t rowNo = State.rows();
+      const size_t colNo = State.columns();
+      mblas::Reserve(NextState, rowNo, colNo);
+
+      for (size_t j = 0; j < rowNo; ++j) {
+        const float* ruh = RUH.data(firstRow + j);
+        const float* t = Temp_.data(j);
+        mblas::GRUGates(NextState.data(j), State.data(j),
+                        ruh, ruh + colNo, ruh + 2 * colNo,
+                        t, t + colNo, t + 2 * colNo, colNo);
       }
     }
+
     size_t GetStateLength() const {
       return w_.U_.rows();
     }
@@ -129,13 +97,6 @@ class GRU {
   private:
     // Model matrices
     const Weights& w_;
-    mutable mblas::Matrix WWx_;
-    mutable mblas::Matrix UUx_;
-    mutable mblas::Matrix Wbbx_;
-    mutable mblas::Matrix lns_WWx_;
-    mutable mblas::Matrix lns_UUx_;
-    mutable mblas::Matrix lnb_WWx_;
-    mutable mblas::Matrix lnb_UUx_;
 
     // reused to avoid allocation
     mutable mblas::Matrix RUH_;
@@ -146,6 +107,7 @@ class GRU {
     mutable mblas::Matrix Temp_2_;
 
     bool layerNormalization_;
+    bool int8_;
 };
 
 }
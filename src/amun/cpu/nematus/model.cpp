@@ -1,5 +1,10 @@
 #include "cpu/nematus/model.h"
 
+#include <algorithm>
+#include <numeric>
+
+#include "cpu/nematus/gru.h"
+
 namespace amunmt {
 namespace CPU {
 namespace Nematus {
@@ -8,28 +13,41 @@ Weights::Transition::Transition(const NpzConverter& model, TransitionType type,
                                 std::string infix)
   : depth_(findTransitionDepth(model, prefix, infix)), type_(type)
 {
+  std::vector<std::string> bx1Keys;
   for (int i = 1; i <= depth_; ++i) {
     U_.emplace_back(model[name(prefix, "U", infix, i)]);
     Ux_.emplace_back(model[name(prefix, "Ux", infix, i)]);
     B_.emplace_back(model(name(prefix, "b", infix, i), true));
-    U_lns_.emplace_back(model[name(prefix, "U", infix, i, "_lns")]);
-    U_lnb_.emplace_back(model[name(prefix, "U", infix, i, "_lnb")]);
-    Ux_lns_.emplace_back(model[name(prefix, "Ux", infix, i, "_lns")]);
-    Ux_lnb_.emplace_back(model[name(prefix, "Ux", infix, i, "_lnb")]);
+    U_lns_.emplace_back(model(name(prefix, "U", infix, i, "_lns"), true));
+    U_lnb_.emplace_back(model(name(prefix, "U", infix, i, "_lnb"), true));
+    Ux_lns_.emplace_back(model(name(prefix, "Ux", infix, i, "_lns"), true));
+    Ux_lnb_.emplace_back(model(name(prefix, "Ux", infix, i, "_lnb"), true));
 
     switch(type) {
       case TransitionType::Encoder:
-        Bx1_.emplace_back(1, Ux_.back().dim(1));
-        const_cast<mblas::Matrix&>(Bx1_.back()) = 0.0f;
+        Bx1_.emplace_back(model.zeros(1, Ux_.back().columns()));
+        bx1Keys.push_back(NpzConverter::zerosKey(1, Ux_.back().columns()));
         Bx2_.emplace_back(model(name(prefix, "bx", infix, i), true));
         break;
       case TransitionType::Decoder:
         Bx1_.emplace_back(model(name(prefix, "bx", infix, i), true));
-        Bx2_.emplace_back(1, Ux_.back().dim(1));
-        const_cast<mblas::Matrix&>(Bx2_.back()) = 0.0f;
+        bx1Keys.push_back(name(prefix, "bx", infix, i));
+        Bx2_.emplace_back(model.zeros(1, Ux_.back().columns()));
         break;
     }
   }
+
+  for (int i = 1; i <= depth_; ++i) {
+    UUx_.emplace_back(model.concat(name(prefix, "U", infix, i), U_[i - 1],
+                                   name(prefix, "Ux", infix, i), Ux_[i - 1]));
+    if (!layerNormalization()) {
+      BBx1_.emplace_back(model.concat(name(prefix, "b", infix, i), B_[i - 1],
+                                      bx1Keys[i - 1], Bx1_[i - 1]));
+    } else if (type == TransitionType::Encoder) {
+      U_lnbB_.emplace_back(model.sum(name(prefix, "U", infix, i, "_lnb"), U_lnb_[i - 1],
+                                     name(prefix, "b", infix, i), B_[i - 1]));
+    }
+  }
 }
 
 int Weights::Transition::findTransitionDepth(const NpzConverter& model, std::string prefix, std::string infix) {
@@ -53,6 +71,10 @@ Weights::Transition::TransitionType Weights::Transition::type() const {
   return type_;
 }
 
+bool Weights::Transition::layerNormalization() const {
+  return U_lns_.size() > 1 && U_lns_[0].columns() > 1;
+}
+
 
 std::string Weights::Transition::name(const std::string& prefix, std::string name, std::string infix,
     int index, std::string suffix)
@@ -61,33 +83,70 @@ std::string Weights::Transition::name(const std::string& prefix, std::string nam
 }
 
 Weights::Embeddings::Embeddings(const NpzConverter& model, const std::string &key)
-  : E_(model[key])
+  : E_(model[key]),
+    EHalf_(model.getHalf({std::make_pair(key, false)}))
 {}
 
 Weights::Embeddings::Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys)
-  : E_(model.getFirstOfMany(keys))
+  : E_(model.getFirstOfMany(keys)),
+    EHalf_(model.getHalf(keys))
 {}
 
+void Weights::Embeddings::Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) const {
+  if (EHalf_.rows()) {
+    mblas::AssembleRows(Rows, EHalf_, ids);
+  } else {
+    mblas::Assemble<mblas::byRow>(Rows, E_, ids);
+  }
+}
+
+size_t Weights::Embeddings::rows() const {
+  return EHalf_.rows() ? EHalf_.rows() : E_.rows();
+}
+
+size_t Weights::Embeddings::columns() const {
+  return EHalf_.rows() ? EHalf_.columns() : E_.columns();
+}
+
+void Weights::Embeddings::ToHalf(mblas::HalfType type) {
+  if (E_.rows()) {
+    EHalf_ = mblas::HalfMatrix(E_, type);
+    E_ = mblas::WeightMatrix();
+  }
+}
+
 Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys)
   : W_(model[prefix + keys.at(0)]),
     B_(model(prefix + keys.at(1), true)),
     U_(model[prefix + keys.at(2)]),
     Wx_(model[prefix + keys.at(3)]),
     Bx1_(model(prefix + keys.at(4), true)),
-    Bx2_(Bx1_.rows(), Bx1_.columns()),
-    Bx3_(B_.rows(), B_.columns()),
+    Bx2_(model.zeros(Bx1_.rows(), Bx1_.columns())),
+    Bx3_(model.zeros(B_.rows(), B_.columns())),
     Ux_(model[prefix + keys.at(5)]),
-    W_lns_(model[prefix + keys.at(6)]),
-    W_lnb_(model[prefix + keys.at(7)]),
-    Wx_lns_(model[prefix + keys.at(8)]),
-    Wx_lnb_(model[prefix + keys.at(9)]),
-    U_lns_(model[prefix + keys.at(10)]),
-    U_lnb_(model[prefix + keys.at(11)]),
-    Ux_lns_(model[prefix + keys.at(12)]),
-    Ux_lnb_(model[prefix + keys.at(13)])
-{
-  const_cast<mblas::Matrix&>(Bx2_) = 0.0f;
-  const_cast<mblas::Matrix&>(Bx3_) = 0.0f;
+    W_lns_(model(prefix + keys.at(6), true)),
+    W_lnb_(model(prefix + keys.at(7), true)),
+    Wx_lns_(model(prefix + keys.at(8), true)),
+    Wx_lnb_(model(prefix + keys.at(9), true)),
+    U_lns_(model(prefix + keys.at(10), true)),
+    U_lnb_(model(prefix + keys.at(11), true)),
+    Ux_lns_(model(prefix + keys.at(12), true)),
+    Ux_lnb_(model(prefix + keys.at(13), true)),
+    WWx_(W_lns_.rows() ? mblas::WeightMatrix()
+                       : model.concat(prefix + keys.at(0), W_, prefix + keys.at(3), Wx_)),
+    UUx_(W_lns_.rows() ? mblas::WeightMatrix()
+                       : model.concat(prefix + keys.at(2), U_, prefix + keys.at(5), Ux_)),
+    BBx1_(W_lns_.rows() ? mblas::WeightMatrix()
+                        : model.concat(prefix + keys.at(1), B_, prefix + keys.at(4), Bx1_))
+{}
+
+void Weights::GRU::ToInt8() {
+  if (WWx_.rows()) {
+    WWx8_ = mblas::Int8Matrix(WWx_);
+    UUx8_ = mblas::Int8Matrix(UUx_);
+    WWx_ = mblas::WeightMatrix();
+    UUx_ = mblas::WeightMatrix();
+  }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -95,32 +154,44 @@ Weights::GRU::GRU(const NpzConverter& model, std::string prefix, std::vector<std
 Weights::DecInit::DecInit(const NpzConverter& model)
   : Wi_(model["ff_state_W"]),
     Bi_(model("ff_state_b", true)),
-    lns_(model["ff_state_ln_s"]),
-    lnb_(model["ff_state_ln_b"])
+    lns_(model("ff_state_ln_s", true)),
+    lnb_(model("ff_state_ln_b", true))
 {}
 
 
 Weights::DecGRU2::DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys)
   : W_(model[prefix + keys.at(0)]),  // Wc
-    B_(1, W_.dim(1)),
+    B_(model.zeros(1, W_.columns())),
     U_(model[prefix + keys.at(1)]),  // U_nl
     Bx3_(model(prefix + keys.at(2), true)),  // b_nl
     Wx_(model[prefix + keys.at(3)]),  // Wcx
-    Bx1_(1, Wx_.dim(1)),
+    Bx1_(model.zeros(1, Wx_.columns())),
     Ux_(model[prefix + keys.at(4)]),  // Ux_nl
     Bx2_(model(prefix + keys.at(5), true)),  // bx_nl
-    W_lns_(model[prefix + keys.at(6)]),  // Wc_lns
-    W_lnb_(model[prefix + keys.at(7)]),  // Wc_nlb
-    Wx_lns_(model[prefix + keys.at(8)]),  // Wcx_lns
-    Wx_lnb_(model[prefix + keys.at(9)]),  // Wcx_lnb
-    U_lns_(model[prefix + keys.at(10)]),  // U_nl_lns
-    U_lnb_(model[prefix + keys.at(11)]),  // U_nl_lnb
-    Ux_lns_(model[prefix + keys.at(12)]),  // Ux_nl_lns
-    Ux_lnb_(model[prefix + keys.at(13)])  // Ux_nl_lnb
+    W_lns_(model(prefix + keys.at(6), true)),  // Wc_lns
+    W_lnb_(model(prefix + keys.at(7), true)),  // Wc_nlb
+    Wx_lns_(model(prefix + keys.at(8), true)),  // Wcx_lns
+    Wx_lnb_(model(prefix + keys.at(9), true)),  // Wcx_lnb
+    U_lns_(model(prefix + keys.at(10), true)),  // U_nl_lns
+    U_lnb_(model(prefix + keys.at(11), true)),  // U_nl_lnb
+    Ux_lns_(model(prefix + keys.at(12), true)),  // Ux_nl_lns
+    Ux_lnb_(model(prefix + keys.at(13), true)),  // Ux_nl_lnb
+    WWx_(W_lns_.rows() ? mblas::WeightMatrix()
+                       : model.concat(prefix + keys.at(0), W_, prefix + keys.at(3), Wx_)),
+    UUx_(W_lns_.rows() ? mblas::WeightMatrix()
+                       : model.concat(prefix + keys.at(1), U_, prefix + keys.at(4), Ux_)),
+    BBx1_(W_lns_.rows() ? mblas::WeightMatrix()
+                        : model.concat(NpzConverter::zerosKey(1, W_.columns()), B_,
+                                       NpzConverter::zerosKey(1, Wx_.columns()), Bx1_))
+{}
 
-{
-  const_cast<mblas::Matrix&>(B_) = 0.0f;
-  const_cast<mblas::Matrix&>(Bx1_) = 0.0f;
+void Weights::DecGRU2::ToInt8() {
+  if (WWx_.rows()) {
+    WWx8_ = mblas::Int8Matrix(WWx_);
+    UUx8_ = mblas::Int8Matrix(UUx_);
+    WWx_ = mblas::WeightMatrix();
+    UUx_ = mblas::WeightMatrix();
+  }
 }
 
 Weights::DecAttention::DecAttention(const NpzConverter& model)
@@ -129,10 +200,10 @@ Weights::DecAttention::DecAttention(const NpzConverter& model)
     B_(model("decoder_b_att", true)),
     U_(model["decoder_Wc_att"]),
     C_(model["decoder_c_tt"]),
-    Wc_att_lns_(model["decoder_Wc_att_lns"]),
-    Wc_att_lnb_(model["decoder_Wc_att_lnb"]),
-    W_comb_lns_(model["decoder_W_comb_att_lns"]),
-    W_comb_lnb_(model["decoder_W_comb_att_lnb"])
+    Wc_att_lns_(model("decoder_Wc_att_lns", true)),
+    Wc_att_lnb_(model("decoder_Wc_att_lnb", true)),
+    W_comb_lns_(model("decoder_W_comb_att_lns", true)),
+    W_comb_lnb_(model("decoder_W_comb_att_lnb", true))
 {}
 
 Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
@@ -144,15 +215,44 @@ Weights::DecSoftmax::DecSoftmax(const NpzConverter& model)
     B3_(model("ff_logit_ctx_b", true)),
     W4_(model.getFirstOfMany({std::make_pair(std::string("ff_logit_W"), false),
                               std::make_pair(std::string("Wemb_dec"), true)})),
+    W4Half_(model.getHalf({std::make_pair(std::string("ff_logit_W"), false)})),
     B4_(model("ff_logit_b", true)),
-    lns_1_(model["ff_logit_lstm_ln_s"]),
-    lns_2_(model["ff_logit_prev_ln_s"]),
-    lns_3_(model["ff_logit_ctx_ln_s"]),
-    lnb_1_(model["ff_logit_lstm_ln_b"]),
-    lnb_2_(model["ff_logit_prev_ln_b"]),
-    lnb_3_(model["ff_logit_ctx_ln_b"])
+    lns_1_(model("ff_logit_lstm_ln_s", true)),
+    lns_2_(model("ff_logit_prev_ln_s", true)),
+    lns_3_(model("ff_logit_ctx_ln_s", true)),
+    lnb_1_(model("ff_logit_lstm_ln_b", true)),
+    lnb_2_(model("ff_logit_prev_ln_b", true)),
+    lnb_3_(model("ff_logit_ctx_ln_b", true))
 {}
 
+void Weights::DecSoftmax::ToHalf(mblas::HalfType type) {
+  if (W4_.rows()) {
+    W4Half_ = mblas::HalfMatrix(W4_, type);
+    W4_ = mblas::WeightMatrix();
+  }
+}
+
+void Weights::DecSoftmax::FuseReadout() {
+  using namespace mblas;
+  if (lns_1_.rows() || lns_2_.rows() || lns_3_.rows()) {
+    return;
+  }
+  W123_ = WeightMatrix(Concat<byRow, Matrix>(Concat<byRow, Matrix>(W1_, W2_), W3_));
+  B123_ = WeightMatrix(B1_ + B2_ + B3_);
+}
+
+void Weights::DecSoftmax::ToInt8() {
+  if (W4Half_.rows()) {
+    mblas::Matrix W4;
+    mblas::ToFloat(W4, W4Half_);
+    W48_ = mblas::Int8Matrix(W4);
+    W4Half_ = mblas::HalfMatrix();
+  } else {
+    W48_ = mblas::Int8Matrix(W4_);
+    W4_ = mblas::WeightMatrix();
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 Weights::Weights(const NpzConverter& model, size_t)
@@ -177,6 +277,53 @@ Weights::Weights(const NpzConverter& model, size_t)
     decTransition_(model, Weights::Transition::TransitionType::Decoder, "decoder_", "_nl")
 {}
 
+void Weights::PrecomputeTables(size_t words, size_t budget, bool readout) {
+  using namespace mblas;
+  const size_t gruCols = decGru1_.W_.columns() + decGru1_.Wx_.columns();
+  const size_t readoutCols = readout ? decSoftmax_.W2_.columns() : 0;
+
+  const size_t vocab = decEmbeddings_.rows();
+  size_t rows = (words && words < vocab) ? words : vocab;
+  rows = std::min(rows, budget / ((gruCols + readoutCols) * sizeof(float)));
+  decTables_ = DecTables();
+  if (rows == 0) {
+    return;
+  }
+
+  std::vector<size_t> ids(rows);
+  std::iota(ids.begin(), ids.end(), 0);
+  Matrix Emb;
+  decEmbeddings_.Lookup(Emb, ids);
+  CPU::GRU<Weights::GRU>(decGru1_).GetInputProjection(decTables_.GRU_, Emb);
+
+  if (readout) {
+    // T2_ of Decoder::Softmax
+    decTables_.Readout_ = Emb * decSoftmax_.W2_;
+    if (decSoftmax_.lns_2_.rows()) {
+      AddBiasLayerNormalization(decTables_.Readout_, decSoftmax_.B2_,
+                                decSoftmax_.lns_2_, decSoftmax_.lnb_2_);
+    } else {
+      AddBiasVector<byRow>(decTables_.Readout_, decSoftmax_.B2_);
+    }
+  }
+}
+
+void Weights::ToHalf(mblas::HalfType type) {
+  encEmbeddings_.ToHalf(type);
+  decEmbeddings_.ToHalf(type);
+  decSoftmax_.ToHalf(type);
+}
+
+void Weights::FuseReadout() {
+  decSoftmax_.FuseReadout();
+}
+
+void Weights::ToInt8() {
+  decGru1_.ToInt8();
+  decGru2_.ToInt8();
+  decSoftmax_.ToInt8();
+}
+
 }  // namespace Nematus
 }  // namespace cpu
 }  // namespace amunmt
@@ -6,6 +6,8 @@
 
 #include "cpu/npz_converter.h"
 
+#include "cpu/mblas/half.h"
+#include "cpu/mblas/int8.h"
 #include "cpu/mblas/matrix.h"
 
 namespace amunmt {
@@ -26,6 +28,8 @@ struct Weights {
 
     TransitionType type() const;
 
+    bool layerNormalization() const;
+
     protected:
       std::string name(const std::string& prefix, std::string name, std::string infix, int index,
           std::string suffix = "");
@@ -35,110 +39,176 @@ struct Weights {
       TransitionType type_;
 
     public:
-      std::vector<mblas::Matrix> B_;
-      std::vector<mblas::Matrix> Bx1_;
-      std::vector<mblas::Matrix> Bx2_;
-      std::vector<mblas::Matrix> U_;
-      std::vector<mblas::Matrix> Ux_;
-
-      std::vector<mblas::Matrix> U_lns_;
-      std::vector<mblas::Matrix> U_lnb_;
-      std::vector<mblas::Matrix> Ux_lns_;
-      std::vector<mblas::Matrix> Ux_lnb_;
-
+      std::vector<mblas::WeightMatrix> B_;
+      std::vector<mblas::WeightMatrix> Bx1_;
+      std::vector<mblas::WeightMatrix> Bx2_;
+      std::vector<mblas::WeightMatrix> U_;
+      std::vector<mblas::WeightMatrix> Ux_;
+
+      std::vector<mblas::WeightMatrix> U_lns_;
+      std::vector<mblas::WeightMatrix> U_lnb_;
+      std::vector<mblas::WeightMatrix> Ux_lns_;
+      std::vector<mblas::WeightMatrix> Ux_lnb_;
+
+      // per layer [U_ | Ux_], so that each layer is one GEMM, and [B_ | Bx1_]
+      // without layer normalisation. With it, U_lnb_ + B_ for the encoder,
+      // whose B_ is added after normalising.
+      std::vector<mblas::WeightMatrix> UUx_;
+      std::vector<mblas::WeightMatrix> BBx1_;
+      std::vector<mblas::WeightMatrix> U_lnbB_;
   };
 
   struct Embeddings {
     Embeddings(const NpzConverter& model, const std::string &key);
     Embeddings(const NpzConverter& model, const std::vector<std::pair<std::string, bool>> keys);
 
-    const mblas::Matrix E_;
+    // Rows = E_(ids, :), from EHalf_ once ToHalf has been called
+    void Lookup(mblas::Matrix& Rows, const std::vector<size_t>& ids) const;
+
+    size_t rows() const;
+    size_t columns() const;
+
+    // Replaces E_ by a 16 bit copy, unless the model already stored it so
+    void ToHalf(mblas::HalfType type);
+
+    mblas::WeightMatrix E_;
+    mblas::HalfMatrix EHalf_;
   };
 
   struct GRU {
     GRU(const NpzConverter& model, std::string prefix, std::vector<std::string> keys);
 
-    const mblas::Matrix W_;
-    const mblas::Matrix B_;
-    const mblas::Matrix U_;
-    const mblas::Matrix Wx_;
-    const mblas::Matrix Bx1_;
-    const mblas::Matrix Bx2_;
-    const mblas::Matrix Bx3_;
-    const mblas::Matrix Ux_;
-
-    const mblas::Matrix W_lns_;
-    const mblas::Matrix W_lnb_;
-    const mblas::Matrix Wx_lns_;
-    const mblas::Matrix Wx_lnb_;
-    const mblas::Matrix U_lns_;
-    const mblas::Matrix U_lnb_;
-    const mblas::Matrix Ux_lns_;
-    const mblas::Matrix Ux_lnb_;
+    // Replaces WWx_ and UUx_ by int8 copies, unless there is no WWx_
+    void ToInt8();
+
+    const mblas::WeightMatrix W_;
+    const mblas::WeightMatrix B_;
+    const mblas::WeightMatrix U_;
+    const mblas::WeightMatrix Wx_;
+    const mblas::WeightMatrix Bx1_;
+    const mblas::WeightMatrix Bx2_;
+    const mblas::WeightMatrix Bx3_;
+    const mblas::WeightMatrix Ux_;
+
+    const mblas::WeightMatrix W_lns_;
+    const mblas::WeightMatrix W_lnb_;
+    const mblas::WeightMatrix Wx_lns_;
+    const mblas::WeightMatrix Wx_lnb_;
+    const mblas::WeightMatrix U_lns_;
+    const mblas::WeightMatrix U_lnb_;
+    const mblas::WeightMatrix Ux_lns_;
+    const mblas::WeightMatrix Ux_lnb_;
+
+    // [W_ | Wx_], [U_ | Ux_] and [B_ | Bx1_], so that models without layer
+    // normalisation need one GEMM per side. Empty for the others.
+    mblas::WeightMatrix WWx_;
+    mblas::WeightMatrix UUx_;
+    const mblas::WeightMatrix BBx1_;
+
+    // int8 copies of WWx_ and UUx_, see mblas::Int8Matrix
+    mblas::Int8Matrix WWx8_;
+    mblas::Int8Matrix UUx8_;
   };
 
   struct DecInit {
     DecInit(const NpzConverter& model);
 
-    const mblas::Matrix Wi_;
-    const mblas::Matrix Bi_;
-    const mblas::Matrix lns_;
-    const mblas::Matrix lnb_;
+    const mblas::WeightMatrix Wi_;
+    const mblas::WeightMatrix Bi_;
+    const mblas::WeightMatrix lns_;
+    const mblas::WeightMatrix lnb_;
   };
 
   struct DecGRU2 {
     DecGRU2(const NpzConverter& model, std::string prefix, std::vector<std::string> keys);
 
-    const mblas::Matrix W_;
-    const mblas::Matrix B_;
-    const mblas::Matrix U_;
-    const mblas::Matrix Wx_;
-    const mblas::Matrix Bx3_;
-    const mblas::Matrix Bx2_;
-    const mblas::Matrix Bx1_;
-    const mblas::Matrix Ux_;
-
-    const mblas::Matrix W_lns_;
-    const mblas::Matrix W_lnb_;
-    const mblas::Matrix Wx_lns_;
-    const mblas::Matrix Wx_lnb_;
-    const mblas::Matrix U_lns_;
-    const mblas::Matrix U_lnb_;
-    const mblas::Matrix Ux_lns_;
-    const mblas::Matrix Ux_lnb_;
+    // Replaces WWx_ and UUx_ by int8 copies, unless there is no WWx_
+    void ToInt8();
+
+    const mblas::WeightMatrix W_;
+    const mblas::WeightMatrix B_;
+    const mblas::WeightMatrix U_;
+    const mblas::WeightMatrix Wx_;
+    const mblas::WeightMatrix Bx3_;
+    const mblas::WeightMatrix Bx2_;
+    const mblas::WeightMatrix Bx1_;
+    const mblas::WeightMatrix Ux_;
+
+    const mblas::WeightMatrix W_lns_;
+    const mblas::WeightMatrix W_lnb_;
+    const mblas::WeightMatrix Wx_lns_;
+    const mblas::WeightMatrix Wx_lnb_;
+    const mblas::WeightMatrix U_lns_;
+    const mblas::WeightMatrix U_lnb_;
+    const mblas::WeightMatrix Ux_lns_;
+    const mblas::WeightMatrix Ux_lnb_;
+
+    // [W_ | Wx_], [U_ | Ux_] and [B_ | Bx1_], so that models without layer
+    // normalisation need one GEMM per side. Empty for the others.
+    mblas::WeightMatrix WWx_;
+    mblas::WeightMatrix UUx_;
+    const mblas::WeightMatrix BBx1_;
+
+    // int8 copies of WWx_ and UUx_, see mblas::Int8Matrix
+    mblas::Int8Matrix WWx8_;
+    mblas::Int8Matrix UUx8_;
   };
 
   struct DecAttention {
     DecAttention(const NpzConverter& model);
 
-    const mblas::Matrix V_;
-    const mblas::Matrix W_;
-    const mblas::Matrix B_;
-    const mblas::Matrix U_;
-    const mblas::Matrix C_;
-    const mblas::Matrix Wc_att_lns_;
-    const mblas::Matrix Wc_att_lnb_;
-    const mblas::Matrix W_comb_lns_;
-    const mblas::Matrix W_comb_lnb_;
+    const mblas::WeightMatrix V_;
+    const mblas::WeightMatrix W_;
+    const mblas::WeightMatrix B_;
+    const mblas::WeightMatrix U_;
+    const mblas::WeightMatrix C_;
+    const mblas::WeightMatrix Wc_att_lns_;
+    const mblas::WeightMatrix Wc_att_lnb_;
+    const mblas::WeightMatrix W_comb_lns_;
+    const mblas::WeightMatrix W_comb_lnb_;
   };
 
   struct DecSoftmax {
     DecSoftmax(const NpzConverter& model);
 
-    const mblas::Matrix W1_;
-    const mblas::Matrix B1_;
-    const mblas::Matrix W2_;
-    const mblas::Matrix B2_;
-    const mblas::Matrix W3_;
-    const mblas::Matrix B3_;
-    const mblas::Matrix W4_;
-    const mblas::Matrix B4_;
-    const mblas::Matrix lns_1_;
-    const mblas::Matrix lns_2_;
-    const mblas::Matrix lns_3_;
-    const mblas::Matrix lnb_1_;
-    const mblas::Matrix lnb_2_;
-    const mblas::Matrix lnb_3_;
+    // Replaces W4_ by a 16 bit copy, unless the model already stored it so
+    void ToHalf(mblas::HalfType type);
+
+    // Fills W123_ and B123_, unless the readout is layer normalised
+    void FuseReadout();
+
+    // Replaces W4_ or W4Half_ by an int8 copy
+    void ToInt8();
+
+    const mblas::WeightMatrix W1_;
+    const mblas::WeightMatrix B1_;
+    const mblas::WeightMatrix W2_;
+    const mblas::WeightMatrix B2_;
+    const mblas::WeightMatrix W3_;
+    const mblas::WeightMatrix B3_;
+    mblas::WeightMatrix W4_;
+    mblas::HalfMatrix W4Half_;
+    const mblas::WeightMatrix B4_;
+    const mblas::WeightMatrix lns_1_;
+    const mblas::WeightMatrix lns_2_;
+    const mblas::WeightMatrix lns_3_;
+    const mblas::WeightMatrix lnb_1_;
+    const mblas::WeightMatrix lnb_2_;
+    const mblas::WeightMatrix lnb_3_;
+
+    // [W1_; W2_; W3_] and B1_ + B2_ + B3_, so that the readout is one GEMM
+    // over the concatenated inputs
+    mblas::WeightMatrix W123_;
+    mblas::WeightMatrix B123_;
+    // int8 copy of the output layer, see mblas::Int8Matrix
+    mblas::Int8Matrix W48_;
+  };
+
+  // Per-word results of the decoder's first operations on a target embedding,
+  // row w belongs to word w. Empty unless PrecomputeTables has been called.
+  struct DecTables {
+    mblas::Matrix GRU_;      // input projection of decGru1_
+    mblas::Matrix Readout_;  // embedding part of the readout of decSoftmax_
   };
 
 
@@ -152,18 +222,38 @@ struct Weights {
     return std::numeric_limits<size_t>::max();
   }
 
-  const Embeddings encEmbeddings_;
-  const Embeddings decEmbeddings_;
+  // Fills decTables_ for the first words target words (all if 0), as far
+  // as budget bytes allow. The readout table is left out unless readout is set.
+  // Called after ToHalf and ToInt8, the tables use the same weights as the
+  // decoder's per-step path.
+  void PrecomputeTables(size_t words, size_t budget, bool readout);
+
+  // Keeps the vocabulary sized matrices, the embeddings and the output layer,
+  // in 16 bit. The other weights are small next to them and stay fp32.
+  void ToHalf(mblas::HalfType type);
+
+  // Stacks the readout projections, see DecSoftmax::FuseReadout. The decoder
+  // then evaluates them as one GEMM.
+  void FuseReadout();
+
+  // Adds int8 copies of the decoder GRU and output layer weights, which the
+  // decoder then multiplies by instead.
+  void ToInt8();
+
+  Embeddings encEmbeddings_;
+  Embeddings decEmbeddings_;
   const GRU encForwardGRU_;
   const GRU encBackwardGRU_;
   const DecInit decInit_;
-  const GRU decGru1_;
-  const DecGRU2 decGru2_;
+  GRU decGru1_;
+  DecGRU2 decGru2_;
   const DecAttention decAttention_;
-  const DecSoftmax decSoftmax_;
+  DecSoftmax decSoftmax_;
   const Transition encForwardTransition_;
   const Transition encBackwardTransition_;
   const Transition decTransition_;
+
+  DecTables decTables_;
 };
 
 inline std::ostream& operator<<(std::ostream &out, const Weights::Embeddings &obj)
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "cpu/mblas/matrix.h"
 #include "model.h"
 
@@ -14,6 +16,7 @@ class Transition {
     void GetNextState(mblas::Matrix& state) const;
 
   protected:
+    void LayerNormalization(int idx) const;
     void ElementwiseOps(mblas::Matrix& state, int idx) const;
 
   private:
@@ -21,13 +24,7 @@ class Transition {
     const Weights::Transition& w_;
 
     // reused to avoid allocation
-    mutable mblas::Matrix UUx_;
-    mutable mblas::Matrix RUH_;
-    mutable mblas::Matrix RUH_1_;
-    mutable mblas::Matrix RUH_2_;
     mutable mblas::Matrix Temp_;
-    mutable mblas::Matrix Temp_1_;
-    mutable mblas::Matrix Temp_2_;
 
     bool layerNormalization_;
 };
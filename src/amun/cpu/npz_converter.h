@@ -1,7 +1,13 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <string>
+
 #include "cnpy/cnpy.h"
+#include "mblas/half.h"
 #include "mblas/matrix.h"
+#include "cpu/binary_model.h"
 
 namespace amunmt {
 namespace CPU {
@@ -46,14 +52,24 @@ class NpzConverter {
       blaze::unpadded, blaze::rowMajor> BlazeWrapper;
 
     bool has(std::string key) const {
+      if (binary_) {
+        return binary_->find(key) != nullptr;
+      }
       auto it = model_.find(key);
       return (it != model_.end());
     }
 
 
+    // Reads an .npz file, or maps a binary model (see cpu/binary_model.h)
+    // whose matrices are then used in place where no transposition is needed.
     NpzConverter(const std::string& file)
-      : model_(cnpy::npz_load(file)),
-        destructed_(false) {
+      : destructed_(false),
+        recorded_(nullptr) {
+        if (BinaryModel::IsBinary(file)) {
+          binary_.reset(new BinaryModel(file));
+        } else {
+          model_ = cnpy::npz_load(file);
+        }
       }
 
     ~NpzConverter() {
@@ -66,70 +82,168 @@ class NpzConverter {
       destructed_ = true;
     }
 
-    mblas::Matrix operator[](const std::string& key) const {
-      BlazeWrapper matrix;
-      auto it = model_.find(key);
-      if(it != model_.end()) {
-        NpyMatrixWrapper np(it->second);
-        matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-      }
-      else {
-        if (key.find("gamma") == std::string::npos) {
-          std::cerr << "Missing " << key << std::endl;
-        }
-      }
-
-      mblas::Matrix ret;
-      ret = matrix;
-      return std::move(ret);
+    mblas::WeightMatrix operator[](const std::string& key) const {
+      return (*this)(key, false);
     }
 
-    mblas::Matrix getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const {
-      BlazeWrapper matrix;
+    mblas::WeightMatrix getFirstOfMany(const std::vector<std::pair<std::string, bool>> keys) const {
       for (auto key : keys) {
-        auto it = model_.find(key.first);
-        if(it != model_.end()) {
-          NpyMatrixWrapper np(it->second);
-          matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
-          mblas::Matrix ret;
-          if (key.second) {
-            const auto matrix2 = blaze::trans(matrix);
-            ret = matrix2;
-          } else {
-            ret = matrix;
+        if (has(key.first)) {
+          if (key.second == keys[0].second) {
+            return (*this)(key.first, key.second);
           }
-          return std::move(ret);
+          // kept under the first key, e.g. tied output embeddings as ff_logit_W
+          return Keep(keys[0].first, Load(key.first, key.second), keys[0].second);
         }
       }
       std::cerr << "Matrix not found: " << keys[0].first << "\n";
 
-      mblas::Matrix ret;
-      return std::move(ret);
+      return mblas::WeightMatrix();
     }
 
-    mblas::Matrix operator()(const std::string& key,
+    mblas::WeightMatrix operator()(const std::string& key,
                                    bool transpose) const {
+      return Keep(key, Load(key, transpose), transpose);
+    }
+
+    // The first of keys the model has, if amun-compile stored it in 16 bit,
+    // otherwise an empty matrix. The fp32 accessors return an empty matrix
+    // for such a key.
+    mblas::HalfMatrix getHalf(const std::vector<std::pair<std::string, bool>> keys) const {
+      for (auto key : keys) {
+        const BinaryModel::Tensor* tensor = binary_ ? binary_->find(key.first) : nullptr;
+        if (!tensor || tensor->type == BinaryModel::Float32
+            || tensor->transposed != key.second) {
+          continue;
+        }
+        mblas::HalfMatrix half(static_cast<const uint16_t*>(tensor->data),
+                               tensor->rows, tensor->cols,
+                               tensor->type == BinaryModel::BFloat16 ? mblas::HalfType::BF16
+                                                                     : mblas::HalfType::FP16,
+                               binary_);
+        if (recorded_) {
+          (*recorded_)[key.first] = Tensor{mblas::WeightMatrix(), half, tensor->transposed};
+        }
+        return half;
+      }
+      return mblas::HalfMatrix();
+    }
+
+    // Weights derived at load time. A compiled model (see amun-compile) has
+    // them under the keys below and they are only mapped, for other models
+    // they are computed here, once per loader:
+    //   "a|b"        columns of a followed by those of b
+    //   "a+b"        a + b
+    //   "zeros:RxC"  R x C zeros
+    mblas::WeightMatrix concat(const std::string& a, const mblas::WeightMatrix& A,
+                               const std::string& b, const mblas::WeightMatrix& B) const {
+      return Derived(a + "|" + b, [&]() {
+        return mblas::WeightMatrix(mblas::Concat<mblas::byColumn, mblas::Matrix>(A, B));
+      });
+    }
+
+    mblas::WeightMatrix sum(const std::string& a, const mblas::WeightMatrix& A,
+                            const std::string& b, const mblas::WeightMatrix& B) const {
+      return Derived(a + "+" + b, [&]() {
+        return mblas::WeightMatrix(A + B);
+      });
+    }
+
+    mblas::WeightMatrix zeros(size_t rows, size_t cols) const {
+      return Derived(zerosKey(rows, cols), [&]() {
+        return mblas::WeightMatrix(rows, cols);
+      });
+    }
+
+    static std::string zerosKey(size_t rows, size_t cols) {
+      return "zeros:" + std::to_string(rows) + "x" + std::to_string(cols);
+    }
+
+    // A tensor as handed out, transposed if it holds the transpose of the
+    // array of its key, or in 16 bit if matrix is empty
+    struct Tensor {
+      mblas::WeightMatrix matrix;
+      mblas::HalfMatrix half;
+      bool transposed;
+    };
+    typedef std::map<std::string, Tensor> Tensors;
+
+    // From now on also adds every tensor handed out to tensors, which is
+    // what amun-compile writes
+    void Record(Tensors* tensors) {
+      recorded_ = tensors;
+    }
+
+  private:
+    void Missing(const std::string& key) const {
+      if (key.find("gamma") == std::string::npos) {
+        std::cerr << "Missing " << key << std::endl;
+      }
+    }
+
+    mblas::WeightMatrix Load(const std::string& key, bool transpose) const {
+      if (binary_) {
+        return FromBinary(key, transpose);
+      }
+
       BlazeWrapper matrix;
       auto it = model_.find(key);
       if(it != model_.end()) {
         NpyMatrixWrapper np(it->second);
         matrix = BlazeWrapper(np.data(), np.size1(), np.size2());
       } else {
-          std::cerr << "Missing " << key << std::endl;
+        Missing(key);
       }
-      mblas::Matrix ret;
       if (transpose) {
-        const auto matrix2 = blaze::trans(matrix);
-        ret = matrix2;
-      } else {
-        ret = matrix;
+        return mblas::WeightMatrix(blaze::trans(matrix));
       }
-      return std::move(ret);
+      return mblas::WeightMatrix(matrix);
+    }
+
+    // Tensors stored the way they are asked for point into the mapping,
+    // the others are copied.
+    mblas::WeightMatrix FromBinary(const std::string& key, bool transpose) const {
+      const BinaryModel::Tensor* tensor = binary_->find(key);
+      if (!tensor) {
+        Missing(key);
+        return mblas::WeightMatrix();
+      }
+      if (tensor->type != BinaryModel::Float32) {
+        // see getHalf
+        return mblas::WeightMatrix();
+      }
+      mblas::WeightMatrix matrix(static_cast<const float*>(tensor->data),
+                                 tensor->rows, tensor->cols, tensor->spacing, binary_);
+      if (transpose != tensor->transposed) {
+        return mblas::WeightMatrix(blaze::trans(matrix));
+      }
+      return matrix;
+    }
+
+    template <class Derive>
+    mblas::WeightMatrix Derived(const std::string& key, const Derive& derive) const {
+      if (binary_ && binary_->find(key)) {
+        return Keep(key, FromBinary(key, false), false);
+      }
+      return Keep(key, derive(), false);
+    }
+
+    const mblas::WeightMatrix& Keep(const std::string& key, const mblas::WeightMatrix& matrix,
+                                    bool transposed) const {
+      if (recorded_ && matrix.rows()) {
+        auto it = recorded_->find(key);
+        // a key asked for both ways is kept as stored in the .npz
+        if (it == recorded_->end() || (it->second.transposed && !transposed)) {
+          (*recorded_)[key] = Tensor{matrix, mblas::HalfMatrix(), transposed};
+        }
+      }
+      return matrix;
     }
 
-  private:
     cnpy::npz_t model_;
+    std::shared_ptr<BinaryModel> binary_;
     bool destructed_;
+    Tensors* recorded_;
 };
 
 }
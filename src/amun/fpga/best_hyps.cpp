@@ -41,7 +41,8 @@ void BestHyps::CalcBeam(
     const std::vector<ScorerPtr>& scorers,
     const Words& filterIndices,
     std::vector<Beam>& beams,
-    std::vector<uint>& beamSizes
+    std::vector<uint>& beamSizes,
+    const std::vector<uint>& rowSizes
     )
 {
   /*
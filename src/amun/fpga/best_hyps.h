@@ -24,7 +24,8 @@ public:
       const std::vector<ScorerPtr>& scorers,
       const Words& filterIndices,
       std::vector<Beam>& beams,
-      std::vector<uint>& beamSizes
+      std::vector<uint>& beamSizes,
+      const std::vector<uint>& rowSizes
       );
 
 protected:
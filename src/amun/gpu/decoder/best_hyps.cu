@@ -19,12 +19,12 @@ void BestHyps::DisAllowUNK(mblas::Matrix& Prob) {
   SetColumn(Prob, UNK_ID, std::numeric_limits<float>::lowest());
 }
 
-void BestHyps::FindBests(const std::vector<uint>& beamSizes, mblas::Matrix& Probs,
+void BestHyps::FindBests(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+               mblas::Matrix& Probs,
                std::vector<float>& outCosts,
-               std::vector<unsigned>& outKeys,
-               const bool isFirst)
+               std::vector<unsigned>& outKeys)
 {
-  nthElement_.getNBestList(beamSizes, Probs, outCosts, outKeys, isFirst);
+  nthElement_.getNBestList(beamSizes, rowSizes, Probs, outCosts, outKeys);
 }
 
 std::vector<SoftAlignmentPtr> BestHyps::GetAlignments(const std::vector<ScorerPtr>& scorers,
@@ -57,7 +57,8 @@ void  BestHyps::CalcBeam(
     const std::vector<ScorerPtr>& scorers,
     const Words& filterIndices,
     std::vector<Beam>& beams,
-    std::vector<uint>& beamSizes)
+    std::vector<uint>& beamSizes,
+    const std::vector<uint>& rowSizes)
 {
   BEGIN_TIMER("CalcBeam");
 
@@ -77,8 +78,6 @@ void  BestHyps::CalcBeam(
               cudaMemcpyHostToDevice);
   //mblas::copy(vCosts.begin(), vCosts.end(), Costs.begin());
 
-  const bool isFirst = (vCosts[0] == 0.0f) ? true : false;
-
   BroadcastVecColumn(weights_.at(scorers[0]->GetName()) * _1 + _2, Probs, Costs);
 
   for (size_t i = 1; i < scorers.size(); ++i) {
@@ -96,7 +95,7 @@ void  BestHyps::CalcBeam(
   std::vector<float> bestCosts;
   std::vector<unsigned> bestKeys;
 
-  FindBests(beamSizes, Probs, bestCosts, bestKeys, isFirst);
+  FindBests(beamSizes, rowSizes, Probs, bestCosts, bestKeys);
 
   std::vector<HostVector<float>> breakDowns;
   if (returnNBestList_) {
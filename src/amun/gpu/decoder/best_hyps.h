@@ -24,10 +24,10 @@ class BestHyps : public BestHypsBase
 
     void DisAllowUNK(mblas::Matrix& Prob);
 
-    void FindBests(const std::vector<uint>& beamSizes, mblas::Matrix& Probs,
+    void FindBests(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                   mblas::Matrix& Probs,
                    std::vector<float>& outCosts,
-                   std::vector<unsigned>& outKeys,
-                   const bool isFirst);
+                   std::vector<unsigned>& outKeys);
 
     std::vector<SoftAlignmentPtr> GetAlignments(const std::vector<ScorerPtr>& scorers,
                                                 size_t hypIndex);
@@ -36,7 +36,8 @@ class BestHyps : public BestHypsBase
         const std::vector<ScorerPtr>& scorers,
         const Words& filterIndices,
         std::vector<Beam>& beams,
-        std::vector<uint>& beamSizes);
+        std::vector<uint>& beamSizes,
+        const std::vector<uint>& rowSizes);
 
   private:
     NthElement nthElement_;
@@ -28,16 +28,16 @@ NthElement::~NthElement()
   //cerr << "FOO2" << endl;
 }
 
-void NthElement::getNBestList(const std::vector<uint>& beamSizes, mblas::Matrix& Probs,
-                  std::vector<float>& outCosts, std::vector<uint>& outKeys,
-                  const bool isFirst) {
+void NthElement::getNBestList(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                  mblas::Matrix& Probs,
+                  std::vector<float>& outCosts, std::vector<uint>& outKeys) {
   /*
   cerr << "beamSizes=" << beamSizes.size() << endl;
   cerr << Debug(beamSizes, 2) << endl;
   cerr << "Probs=" << Probs.Debug(0) << endl;
   cerr << "outCosts=" << outCosts.size() << endl;
   cerr << "outKeys=" << outKeys.size() << endl;
-  cerr << "isFirst=" << isFirst << endl;
+  cerr << "rowSizes=" << Debug(rowSizes, 2) << endl;
   cerr << endl;
   */
   HostVector<uint> cummulatedBeamSizes(beamSizes.size() + 1);
@@ -49,7 +49,7 @@ void NthElement::getNBestList(const std::vector<uint>& beamSizes, mblas::Matrix&
   for (uint i = 0; i < beamSizes.size(); ++i) {
 
     cummulatedBeamSizes[i + 1] = cummulatedBeamSizes[i] + beamSizes[i];
-    batchFirstElementIdxs[i + 1] = ((isFirst) ? (i + 1) : cummulatedBeamSizes[i + 1]) * vocabSize;
+    batchFirstElementIdxs[i + 1] = batchFirstElementIdxs[i] + rowSizes[i] * vocabSize;
   }
 
   uint numHypos = cummulatedBeamSizes.back();
@@ -18,9 +18,9 @@ class NthElement {
     NthElement(uint maxBeamSize, uint maxBatchSize);
     virtual ~NthElement();
 
-    void getNBestList(const std::vector<uint>& beamSizes, mblas::Matrix& Probs,
-                      std::vector<float>& outCosts, std::vector<uint>& outKeys,
-                      const bool isFirst=false);
+    void getNBestList(const std::vector<uint>& beamSizes, const std::vector<uint>& rowSizes,
+                      mblas::Matrix& Probs,
+                      std::vector<float>& outCosts, std::vector<uint>& outKeys);
 
     void GetPairs(uint number,
                   std::vector<uint>& outKeys,